@@ -0,0 +1,49 @@
+#include "AlertSource.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+
+GpioAlertSource::GpioAlertSource(unsigned gpio)
+        : gpio_dir("/sys/class/gpio/gpio" + std::to_string(gpio)) {
+    if (access(gpio_dir.c_str(), F_OK) != 0) {
+        std::ofstream("/sys/class/gpio/export") << gpio;
+    }
+    std::ofstream(gpio_dir + "/direction") << "in";
+    // Only the falling edge, nINT stays low until the results are read.
+    std::ofstream(gpio_dir + "/edge") << "falling";
+
+    value_fd = open((gpio_dir + "/value").c_str(), O_RDONLY);
+    if (value_fd < 0) {
+        std::cerr << "Unable to open " << gpio_dir << "/value. " << strerror(errno) << std::endl;
+        throw 1;
+    }
+}
+
+GpioAlertSource::~GpioAlertSource() {
+    if (value_fd >= 0) close(value_fd);
+}
+
+// Reading the value also acknowledges a pending edge for poll().
+bool GpioAlertSource::asserted() {
+    char value = '1';
+    lseek(value_fd, 0, SEEK_SET);
+    if (read(value_fd, &value, 1) != 1) return false;
+    return value == '0';
+}
+
+bool GpioAlertSource::wait(std::chrono::milliseconds timeout) {
+    // The line may already be low, in which case there won't be another edge.
+    if (asserted()) return true;
+
+    pollfd pfd{};
+    pfd.fd = value_fd;
+    pfd.events = POLLPRI | POLLERR;
+    auto ready = poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (ready <= 0) return false;
+    return asserted();
+}
@@ -0,0 +1,32 @@
+#ifndef IAQ_ALERTSOURCE_H
+#define IAQ_ALERTSOURCE_H
+
+#include <chrono>
+#include <string>
+
+// Interrupt line of a sensor, e.g. the active low nINT pin of the CCS811.
+class AlertSource {
+public:
+    virtual ~AlertSource() = default;
+
+    // Waits until the line is asserted or the timeout passes. Returns true if it is asserted.
+    virtual bool wait(std::chrono::milliseconds timeout) = 0;
+};
+
+// Active low interrupt line wired to a GPIO, accessed through the sysfs GPIO interface.
+class GpioAlertSource : public AlertSource {
+public:
+    explicit GpioAlertSource(unsigned gpio);
+
+    ~GpioAlertSource() override;
+
+    bool wait(std::chrono::milliseconds timeout) override;
+
+private:
+    const std::string gpio_dir;
+    int value_fd = -1;
+
+    bool asserted();
+};
+
+#endif //IAQ_ALERTSOURCE_H
@@ -0,0 +1,600 @@
+#include "Archive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+static const char FILE_MAGIC[4] = {'I', 'A', 'Q', 'A'};
+static const uint32_t FILE_VERSION = 1;
+static const uint32_t BLOCK_MAGIC = 0x42514149; // "IAQB"
+static const uint32_t FOOTER_MAGIC = 0x49514149; // "IAQI"
+
+// Timestamp, BMP280 temperature and pressure, Si7021 temperature and humidity, CO2, TVOC.
+static const size_t COLUMNS = 7;
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    double quantum;
+    uint32_t block_samples;
+    uint32_t reserved;
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t sample_count;
+    int64_t first_timestamp_ms;
+    int64_t last_timestamp_ms;
+    uint32_t column_bytes[COLUMNS];
+    uint32_t reserved;
+};
+
+struct Footer {
+    uint64_t index_offset;
+    uint32_t block_count;
+    uint32_t magic;
+};
+
+static inline uint64_t mask(unsigned bits) {
+    return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+static inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// MSB first bit stream.
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t> &bytes) : bytes(bytes) {}
+
+    void write(uint64_t value, unsigned bits) {
+        value &= mask(bits);
+        while (bits > 0) {
+            unsigned take = std::min(bits, 64 - fill);
+            uint64_t chunk = (value >> (bits - take)) & mask(take);
+            acc = take == 64 ? chunk : (acc << take) | chunk;
+            fill += take;
+            bits -= take;
+            if (fill == 64) {
+                for (int shift = 56; shift >= 0; shift -= 8) bytes.push_back(static_cast<uint8_t>(acc >> shift));
+                acc = 0;
+                fill = 0;
+            }
+        }
+    }
+
+    // Pads the stream to a whole byte.
+    void finish() {
+        while (fill >= 8) {
+            fill -= 8;
+            bytes.push_back(static_cast<uint8_t>(acc >> fill));
+        }
+        if (fill > 0) bytes.push_back(static_cast<uint8_t>(acc << (8 - fill)));
+        acc = 0;
+        fill = 0;
+    }
+
+private:
+    std::vector<uint8_t> &bytes;
+    uint64_t acc = 0;
+    unsigned fill = 0;
+};
+
+// Reads past the end of the data return zero bits, so corrupt blocks can't read out of bounds.
+class BitReader {
+public:
+    BitReader(const uint8_t *data, size_t size) : data(data), end(data + size) {}
+
+    uint64_t read(unsigned bits) {
+        uint64_t result = 0;
+        while (bits > 0) {
+            if (avail == 0) refill();
+            unsigned take = std::min(bits, avail);
+            uint64_t chunk = (acc >> (avail - take)) & mask(take);
+            result = take == 64 ? chunk : (result << take) | chunk;
+            avail -= take;
+            bits -= take;
+        }
+        return result;
+    }
+
+    bool bit() {
+        if (avail == 0) refill();
+        avail--;
+        return (acc >> avail) & 1;
+    }
+
+private:
+    const uint8_t *data;
+    const uint8_t *end;
+    uint64_t acc = 0;
+    unsigned avail = 0;
+
+    void refill() {
+        if (end - data >= 8) {
+            acc = 0;
+            for (int i = 0; i < 8; i++) acc = (acc << 8) | data[i];
+            data += 8;
+            avail = 64;
+        } else if (data < end) {
+            acc = 0;
+            avail = 0;
+            while (data < end) {
+                acc = (acc << 8) | *data++;
+                avail += 8;
+            }
+        } else {
+            acc = 0;
+            avail = 64;
+        }
+    }
+};
+
+// Signed values are zigzag encoded and stored in the smallest of a few bucket sizes. The prefix
+// is '0' for zero, and for bucket i, i + 1 ones followed by a zero (no zero for the last bucket).
+static const unsigned TIMESTAMP_BUCKETS[] = {7, 9, 12, 32, 64};
+static const unsigned VALUE_BUCKETS[] = {4, 8, 16, 64};
+
+template<size_t N>
+static void write_bucketed(BitWriter &writer, int64_t value, const unsigned (&buckets)[N]) {
+    uint64_t zz = zigzag(value);
+    if (zz == 0) {
+        writer.write(0, 1);
+        return;
+    }
+    for (size_t i = 0; i < N; i++) {
+        if (i + 1 < N && zz >= (1ULL << buckets[i])) continue;
+        if (i + 1 < N) {
+            writer.write(mask(i + 1) << 1, static_cast<unsigned>(i + 2));
+        } else {
+            writer.write(mask(N), static_cast<unsigned>(N));
+        }
+        writer.write(zz, buckets[i]);
+        return;
+    }
+}
+
+template<size_t N>
+static int64_t read_bucketed(BitReader &reader, const unsigned (&buckets)[N]) {
+    size_t ones = 0;
+    while (ones < N && reader.bit()) ones++;
+    if (ones == 0) return 0;
+    return unzigzag(reader.read(buckets[ones - 1]));
+}
+
+// Gorilla style XOR compression of consecutive values of Width bits. A zero XOR takes one bit, a
+// XOR that fits into the previous window of meaningful bits takes '10' and the meaningful bits,
+// anything else '11', the number of leading zeros, the length of the window and its bits.
+template<unsigned Width>
+class XorEncoder {
+public:
+    void write(BitWriter &writer, uint64_t value) {
+        if (first) {
+            writer.write(value, Width);
+            first = false;
+            prev = value;
+            return;
+        }
+        uint64_t x = (value ^ prev) & mask(Width);
+        prev = value;
+        if (x == 0) {
+            writer.write(0, 1);
+            return;
+        }
+        unsigned lead = std::min(31u, static_cast<unsigned>(__builtin_clzll(x)) - (64 - Width));
+        unsigned trail = static_cast<unsigned>(__builtin_ctzll(x));
+        if (window_len > 0 && lead >= window_lead && trail >= Width - window_lead - window_len) {
+            writer.write(2, 2);
+            writer.write(x >> (Width - window_lead - window_len), window_len);
+            return;
+        }
+        window_lead = lead;
+        window_len = Width - lead - trail;
+        writer.write(3, 2);
+        writer.write(lead, 5);
+        writer.write(window_len - 1, Width == 64 ? 6 : 5);
+        writer.write(x >> trail, window_len);
+    }
+
+private:
+    bool first = true;
+    uint64_t prev = 0;
+    unsigned window_lead = 0;
+    unsigned window_len = 0;
+};
+
+template<unsigned Width>
+class XorDecoder {
+public:
+    uint64_t read(BitReader &reader) {
+        if (first) {
+            first = false;
+            prev = reader.read(Width);
+            return prev;
+        }
+        if (!reader.bit()) return prev;
+        if (reader.bit()) {
+            window_lead = static_cast<unsigned>(reader.read(5));
+            window_len = static_cast<unsigned>(reader.read(Width == 64 ? 6 : 5)) + 1;
+            if (window_lead + window_len > Width) window_len = Width - window_lead;
+        }
+        prev ^= reader.read(window_len) << (Width - window_lead - window_len);
+        return prev;
+    }
+
+private:
+    bool first = true;
+    uint64_t prev = 0;
+    unsigned window_lead = 0;
+    unsigned window_len = 0;
+};
+
+static uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Quantized value of missing (NaN) and out of range readings, decoded as NaN. Deltas to and from
+// it wrap around, which the bucketed encoding stores in its 64 bit bucket.
+static const int64_t QUANTUM_MISSING = INT64_MIN;
+
+static int64_t quantize(double value, double quantum) {
+    double q = std::round(value / quantum);
+    if (!(std::fabs(q) < 9.2e18)) return QUANTUM_MISSING;
+    return static_cast<int64_t>(q);
+}
+
+static int64_t wrapping_sub(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
+
+static int64_t wrapping_add(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+template<typename T>
+static void encode_real_column(const std::vector<ArchiveSample> &samples, T ArchiveSample::*field, double quantum,
+                               std::vector<uint8_t> &bytes) {
+    BitWriter writer(bytes);
+    if (quantum > 0) {
+        int64_t prev = 0;
+        for (auto &sample : samples) {
+            auto q = quantize(static_cast<double>(sample.*field), quantum);
+            write_bucketed(writer, wrapping_sub(q, prev), VALUE_BUCKETS);
+            prev = q;
+        }
+    } else if (sizeof(T) == 8) {
+        XorEncoder<64> encoder;
+        for (auto &sample : samples) encoder.write(writer, double_bits(static_cast<double>(sample.*field)));
+    } else {
+        XorEncoder<32> encoder;
+        for (auto &sample : samples) encoder.write(writer, float_bits(static_cast<float>(sample.*field)));
+    }
+    writer.finish();
+}
+
+template<typename T>
+static void decode_real_column(BitReader reader, T ArchiveSample::*field, double quantum, ArchiveSample *samples,
+                               size_t count) {
+    if (quantum > 0) {
+        int64_t q = 0;
+        for (size_t i = 0; i < count; i++) {
+            q = wrapping_add(q, read_bucketed(reader, VALUE_BUCKETS));
+            samples[i].*field = q == QUANTUM_MISSING ? static_cast<T>(NAN) : static_cast<T>(q * quantum);
+        }
+    } else if (sizeof(T) == 8) {
+        XorDecoder<64> decoder;
+        for (size_t i = 0; i < count; i++) samples[i].*field = static_cast<T>(bits_double(decoder.read(reader)));
+    } else {
+        XorDecoder<32> decoder;
+        for (size_t i = 0; i < count; i++) {
+            samples[i].*field = static_cast<T>(bits_float(static_cast<uint32_t>(decoder.read(reader))));
+        }
+    }
+}
+
+static void encode_int_column(const std::vector<ArchiveSample> &samples, uint16_t ArchiveSample::*field,
+                              std::vector<uint8_t> &bytes) {
+    BitWriter writer(bytes);
+    int64_t prev = 0;
+    for (auto &sample : samples) {
+        write_bucketed(writer, static_cast<int64_t>(sample.*field) - prev, VALUE_BUCKETS);
+        prev = sample.*field;
+    }
+    writer.finish();
+}
+
+static void decode_int_column(BitReader reader, uint16_t ArchiveSample::*field, ArchiveSample *samples, size_t count) {
+    int64_t value = 0;
+    for (size_t i = 0; i < count; i++) {
+        value += read_bucketed(reader, VALUE_BUCKETS);
+        samples[i].*field = static_cast<uint16_t>(value);
+    }
+}
+
+static void encode_timestamp_column(const std::vector<ArchiveSample> &samples, std::vector<uint8_t> &bytes) {
+    BitWriter writer(bytes);
+    writer.write(static_cast<uint64_t>(samples.front().timestamp_ms), 64);
+    int64_t prev = samples.front().timestamp_ms;
+    int64_t prev_delta = 0;
+    for (size_t i = 1; i < samples.size(); i++) {
+        int64_t delta = samples[i].timestamp_ms - prev;
+        write_bucketed(writer, delta - prev_delta, TIMESTAMP_BUCKETS);
+        prev = samples[i].timestamp_ms;
+        prev_delta = delta;
+    }
+    writer.finish();
+}
+
+static void decode_timestamp_column(BitReader reader, ArchiveSample *samples, size_t count) {
+    int64_t timestamp = static_cast<int64_t>(reader.read(64));
+    int64_t delta = 0;
+    samples[0].timestamp_ms = timestamp;
+    for (size_t i = 1; i < count; i++) {
+        delta += read_bucketed(reader, TIMESTAMP_BUCKETS);
+        timestamp += delta;
+        samples[i].timestamp_ms = timestamp;
+    }
+}
+
+ArchiveWriter::ArchiveWriter(const std::string &path, double quantum, uint32_t block_samples)
+        : quantum(quantum),
+          block_samples(std::max<uint32_t>(block_samples, 1)) {
+    std::ifstream existing(path, std::ios::binary | std::ios::ate);
+    auto existing_size = existing ? static_cast<uint64_t>(existing.tellg()) : 0;
+
+    if (existing_size > 0) {
+        FileHeader header{};
+        existing.seekg(0);
+        if (!existing.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+            memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != FILE_VERSION) {
+            std::cerr << "[Archive] " << path << " exists and isn't a supported archive." << std::endl;
+            throw 1;
+        }
+        this->quantum = header.quantum;
+        this->block_samples = std::max<uint32_t>(header.block_samples, 1);
+
+        // New blocks replace the index and footer of a closed archive, or the incomplete block of
+        // one that wasn't closed.
+        auto data_end = load_index(existing, existing_size, index);
+        existing.close();
+        if (data_end < existing_size && truncate(path.c_str(), static_cast<off_t>(data_end)) != 0) {
+            std::cerr << "[Archive] Unable to truncate " << path << ". " << strerror(errno) << std::endl;
+            throw 1;
+        }
+        out.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(static_cast<std::streamoff>(data_end));
+        if (!index.empty()) last_timestamp_ms = index.back().last_timestamp_ms;
+    } else {
+        existing.close();
+        out.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+        FileHeader header{};
+        memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+        header.version = FILE_VERSION;
+        header.quantum = this->quantum;
+        header.block_samples = this->block_samples;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    if (!out) {
+        std::cerr << "[Archive] Unable to open " << path << " for writing." << std::endl;
+        throw 1;
+    }
+    block.reserve(this->block_samples);
+}
+
+ArchiveWriter::~ArchiveWriter() {
+    close();
+}
+
+void ArchiveWriter::append(const ArchiveSample &sample) {
+    if (closed) return;
+    block.push_back(sample);
+    // Clamping keeps the blocks, and the index, in time order.
+    if (block.back().timestamp_ms < last_timestamp_ms) block.back().timestamp_ms = last_timestamp_ms;
+    last_timestamp_ms = block.back().timestamp_ms;
+    if (block.size() >= block_samples) flush_block();
+}
+
+void ArchiveWriter::flush() {
+    if (!closed) flush_block();
+}
+
+void ArchiveWriter::flush_block() {
+    if (block.empty()) return;
+
+    std::vector<uint8_t> columns[COLUMNS];
+    encode_timestamp_column(block, columns[0]);
+    encode_real_column(block, &ArchiveSample::bmp280_temperature, quantum, columns[1]);
+    encode_real_column(block, &ArchiveSample::bmp280_pressure, quantum, columns[2]);
+    encode_real_column(block, &ArchiveSample::si7021_temperature, quantum, columns[3]);
+    encode_real_column(block, &ArchiveSample::si7021_humidity, quantum, columns[4]);
+    encode_int_column(block, &ArchiveSample::ccs811_co2, columns[5]);
+    encode_int_column(block, &ArchiveSample::ccs811_tvoc, columns[6]);
+
+    BlockHeader header{};
+    header.magic = BLOCK_MAGIC;
+    header.sample_count = static_cast<uint32_t>(block.size());
+    header.first_timestamp_ms = block.front().timestamp_ms;
+    header.last_timestamp_ms = block.back().timestamp_ms;
+    for (size_t c = 0; c < COLUMNS; c++) header.column_bytes[c] = static_cast<uint32_t>(columns[c].size());
+
+    index.push_back({header.first_timestamp_ms, header.last_timestamp_ms, static_cast<uint64_t>(out.tellp()),
+                     header.sample_count, 0});
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (auto &column : columns) {
+        out.write(reinterpret_cast<const char *>(column.data()), column.size());
+    }
+    // Complete blocks are recoverable even if the writer never gets to close the archive.
+    out.flush();
+    block.clear();
+}
+
+void ArchiveWriter::close() {
+    if (closed) return;
+    closed = true;
+    flush_block();
+
+    Footer footer{};
+    footer.index_offset = static_cast<uint64_t>(out.tellp());
+    footer.block_count = static_cast<uint32_t>(index.size());
+    footer.magic = FOOTER_MAGIC;
+    out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(IndexEntry));
+    out.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+    out.close();
+}
+
+ArchiveReader::ArchiveReader(const std::string &path)
+        : in(path, std::ios::binary) {
+    FileHeader header{};
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != FILE_VERSION) {
+        std::cerr << "[Archive] " << path << " isn't a supported archive." << std::endl;
+        throw 1;
+    }
+    quantum = header.quantum;
+
+    in.seekg(0, std::ios::end);
+    auto file_size = static_cast<uint64_t>(in.tellg());
+
+    ArchiveWriter::load_index(in, file_size, index);
+}
+
+uint64_t ArchiveWriter::load_index(std::istream &in, uint64_t file_size, std::vector<IndexEntry> &index) {
+    Footer footer{};
+    if (file_size >= sizeof(FileHeader) + sizeof(footer)) {
+        in.seekg(static_cast<std::streamoff>(file_size - sizeof(footer)));
+        in.read(reinterpret_cast<char *>(&footer), sizeof(footer));
+    }
+    if (footer.magic == FOOTER_MAGIC &&
+        footer.index_offset + footer.block_count * sizeof(IndexEntry) + sizeof(footer) == file_size) {
+        index.resize(footer.block_count);
+        in.seekg(static_cast<std::streamoff>(footer.index_offset));
+        in.read(reinterpret_cast<char *>(index.data()), index.size() * sizeof(IndexEntry));
+        if (in) return footer.index_offset;
+    }
+
+    // The writer didn't get to close the archive, recover the complete blocks.
+    in.clear();
+    index.clear();
+    return rebuild_index(in, sizeof(FileHeader), file_size, index);
+}
+
+uint64_t ArchiveWriter::rebuild_index(std::istream &in, uint64_t data_start, uint64_t data_end,
+                                      std::vector<IndexEntry> &index) {
+    uint64_t offset = data_start;
+    BlockHeader header{};
+    while (offset + sizeof(header) <= data_end) {
+        in.seekg(static_cast<std::streamoff>(offset));
+        if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != BLOCK_MAGIC) break;
+
+        uint64_t block_size = sizeof(header);
+        for (auto bytes : header.column_bytes) block_size += bytes;
+        if (offset + block_size > data_end) break;
+
+        index.push_back({header.first_timestamp_ms, header.last_timestamp_ms, offset, header.sample_count, 0});
+        offset += block_size;
+    }
+    in.clear();
+    return offset;
+}
+
+uint64_t ArchiveReader::get_sample_count() const {
+    uint64_t count = 0;
+    for (auto &entry : index) count += entry.sample_count;
+    return count;
+}
+
+void ArchiveReader::decode_block(size_t block, std::vector<ArchiveSample> &samples) {
+    BlockHeader header{};
+    in.seekg(index[block].offset);
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in || header.magic != BLOCK_MAGIC || header.sample_count == 0) {
+        in.clear();
+        return;
+    }
+
+    size_t total = 0;
+    for (auto bytes : header.column_bytes) total += bytes;
+    std::vector<uint8_t> data(total);
+    in.read(reinterpret_cast<char *>(data.data()), total);
+    if (!in) {
+        in.clear();
+        return;
+    }
+
+    auto first = samples.size();
+    samples.resize(first + header.sample_count);
+    auto *out = &samples[first];
+    size_t count = header.sample_count;
+
+    const uint8_t *column = data.data();
+    BitReader readers[COLUMNS] = {
+            BitReader(column, header.column_bytes[0]),
+            BitReader(column += header.column_bytes[0], header.column_bytes[1]),
+            BitReader(column += header.column_bytes[1], header.column_bytes[2]),
+            BitReader(column += header.column_bytes[2], header.column_bytes[3]),
+            BitReader(column += header.column_bytes[3], header.column_bytes[4]),
+            BitReader(column += header.column_bytes[4], header.column_bytes[5]),
+            BitReader(column += header.column_bytes[5], header.column_bytes[6])
+    };
+    decode_timestamp_column(readers[0], out, count);
+    decode_real_column(readers[1], &ArchiveSample::bmp280_temperature, quantum, out, count);
+    decode_real_column(readers[2], &ArchiveSample::bmp280_pressure, quantum, out, count);
+    decode_real_column(readers[3], &ArchiveSample::si7021_temperature, quantum, out, count);
+    decode_real_column(readers[4], &ArchiveSample::si7021_humidity, quantum, out, count);
+    decode_int_column(readers[5], &ArchiveSample::ccs811_co2, out, count);
+    decode_int_column(readers[6], &ArchiveSample::ccs811_tvoc, out, count);
+}
+
+void ArchiveReader::read_range(int64_t from_ms, int64_t to_ms, std::vector<ArchiveSample> &samples) {
+    // Blocks are in time order, skip straight to the first one that can overlap the range.
+    auto it = std::lower_bound(index.begin(), index.end(), from_ms,
+                               [](const ArchiveWriter::IndexEntry &entry, int64_t ts) {
+                                   return entry.last_timestamp_ms < ts;
+                               });
+    for (; it != index.end() && it->first_timestamp_ms < to_ms; ++it) {
+        auto first = samples.size();
+        decode_block(static_cast<size_t>(it - index.begin()), samples);
+
+        // Only the blocks at either end of the range can contain samples outside of it.
+        if (it->first_timestamp_ms < from_ms || it->last_timestamp_ms >= to_ms) {
+            auto begin = samples.begin() + first;
+            auto end = std::remove_if(begin, samples.end(), [&](const ArchiveSample &s) {
+                return s.timestamp_ms < from_ms || s.timestamp_ms >= to_ms;
+            });
+            samples.erase(end, samples.end());
+        }
+    }
+}
+
+void ArchiveReader::read_all(std::vector<ArchiveSample> &samples) {
+    for (size_t block = 0; block < index.size(); block++) decode_block(block, samples);
+}
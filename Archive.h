@@ -0,0 +1,102 @@
+#ifndef IAQ_ARCHIVE_H
+#define IAQ_ARCHIVE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One processed sample of a board as kept in the long-term archive.
+struct ArchiveSample {
+    int64_t timestamp_ms;
+    double bmp280_temperature;
+    double bmp280_pressure;
+    float si7021_temperature;
+    float si7021_humidity;
+    uint16_t ccs811_co2;
+    uint16_t ccs811_tvoc;
+};
+
+// Compressed columnar time series archive.
+//
+// Samples are grouped into blocks of up to a fixed number of samples. Within a block every series
+// is stored as its own bit packed column: timestamps as delta-of-delta, CO2/TVOC as deltas and the
+// real valued series either as deltas of values quantized to a fixed step (the default, 0.01 like
+// the text output; NaN and infinite readings are stored as NaN) or, for a quantum of 0,
+// losslessly as the XOR of consecutive values. An index of the time range of every block is
+// written at the end of the file so that range queries only read and decode the blocks they
+// overlap.
+//
+// The file layout is little endian:
+//   FileHeader, (BlockHeader, columns)*, IndexEntry*, Footer
+class ArchiveWriter {
+public:
+    // Opens the archive at path for appending, or creates it. An existing archive keeps its own
+    // quantum and block size. Its index is recovered, also when it was never closed, in which case
+    // an incomplete block at the end of the file is dropped.
+    explicit ArchiveWriter(const std::string &path, double quantum = 0.01, uint32_t block_samples = 1024);
+
+    ~ArchiveWriter();
+
+    // Timestamps must not go backwards, range queries rely on it. A sample older than the last
+    // one, e.g. after the wall clock was stepped back, is stored with the last sample's timestamp.
+    void append(const ArchiveSample &sample);
+
+    // Writes the pending samples as a short block, so that they survive the process being killed.
+    // Short blocks compress worse, call this every few minutes rather than after every sample.
+    void flush();
+
+    // Writes the pending block and the index. Called by the destructor.
+    void close();
+
+private:
+    struct IndexEntry {
+        int64_t first_timestamp_ms;
+        int64_t last_timestamp_ms;
+        uint64_t offset;
+        uint32_t sample_count;
+        uint32_t reserved;
+    };
+
+    std::fstream out;
+    double quantum;
+    uint32_t block_samples;
+    std::vector<ArchiveSample> block;
+    std::vector<IndexEntry> index;
+    int64_t last_timestamp_ms = INT64_MIN;
+    bool closed = false;
+
+    void flush_block();
+
+    // Reads the index of an archive, or rebuilds it from the block headers if the archive wasn't
+    // closed. Returns the offset just past the last complete block.
+    static uint64_t load_index(std::istream &in, uint64_t file_size, std::vector<IndexEntry> &index);
+
+    static uint64_t rebuild_index(std::istream &in, uint64_t data_start, uint64_t data_end,
+                                  std::vector<IndexEntry> &index);
+
+    friend class ArchiveReader;
+};
+
+class ArchiveReader {
+public:
+    explicit ArchiveReader(const std::string &path);
+
+    size_t get_block_count() const { return index.size(); }
+
+    uint64_t get_sample_count() const;
+
+    // Appends the samples with from_ms <= timestamp_ms < to_ms to samples.
+    void read_range(int64_t from_ms, int64_t to_ms, std::vector<ArchiveSample> &samples);
+
+    void read_all(std::vector<ArchiveSample> &samples);
+
+private:
+    std::ifstream in;
+    double quantum = 0;
+    std::vector<ArchiveWriter::IndexEntry> index;
+
+    void decode_block(size_t block, std::vector<ArchiveSample> &samples);
+};
+
+#endif //IAQ_ARCHIVE_H
@@ -1,34 +1,27 @@
 #include "BMP280.h"
+#include "Trace.h"
 
 #include <cstring>
-#include <fcntl.h>
 #include <iostream>
-#include <linux/i2c-dev.h>
 #include <thread>
 #include <unistd.h>
-#include <sys/ioctl.h>
 
 #undef DBG
 
 BMP280::BMP280(std::string i2c_dev_name, uint8_t ccs811_addr)
-        : i2c_dev_name(std::move(i2c_dev_name)),
-          ccs811_addr(ccs811_addr) {
-    open_device();
-    init();
-}
+        : BMP280(std::make_shared<LinuxI2CDevice>(std::move(i2c_dev_name), ccs811_addr)) {}
 
-BMP280::~BMP280() {
-    close_device();
-}
-
-void BMP280::close_device() {
-    if (i2c_fd >= 0) close(i2c_fd);
+BMP280::BMP280(std::shared_ptr<I2CDevice> device)
+        : device(std::move(device)) {
+    init();
 }
 
 void BMP280::init() {
+    TraceScope trace("BMP280", "init");
+
     std::cout << "Resetting BMP280..." << std::endl;
     reset();
-    std::this_thread::sleep_for(std::chrono::seconds(3));
+    sleep(std::chrono::seconds(3));
 
     auto id = read_id();
     if (id != 0x58) {
@@ -59,27 +52,17 @@ void BMP280::init() {
     write_data(cmd, 2);
 }
 
-void BMP280::open_device() {
-    i2c_fd = open(i2c_dev_name.c_str(), O_RDWR);
-    if (i2c_fd < 0) {
-        std::cerr << "Unable to open" << i2c_dev_name << ". " << strerror(errno) << std::endl;
-        throw 1;
-    }
-
-    if (ioctl(i2c_fd, I2C_SLAVE, ccs811_addr) < 0) {
-        std::cerr << "Failed to communicate with the device. " << strerror(errno) << std::endl;
-        throw 1;
-    }
-}
-
 std::unique_ptr<std::vector<uint8_t>> BMP280::read_registers(uint8_t start, size_t count) {
+    TraceScope trace("BMP280", "read_registers");
+
     uint8_t data[] = {start};
     write_data(data, 1);
 
     auto *read_buffer = new uint8_t[count];
-    auto bytes_read = read(i2c_fd, read_buffer, count);
+    auto bytes_read = device->read(read_buffer, count);
 
     if (bytes_read < 0) {
+        delete[] read_buffer;
         // return an empty vector if we can't read anything.
         return std::make_unique<std::vector<uint8_t>>();
     }
@@ -101,6 +84,8 @@ std::unique_ptr<std::vector<uint8_t>> BMP280::read_registers(uint8_t start, size
 
 
 void BMP280::write_data(uint8_t *buffer, size_t buffer_len) {
+    TraceScope trace("BMP280", "write_data");
+
 #ifdef DBG
     std::cerr << "\tWrite: ";
     for (size_t i = 0; i < buffer_len; i++) {
@@ -108,7 +93,7 @@ void BMP280::write_data(uint8_t *buffer, size_t buffer_len) {
     }
 #endif
 
-    auto write_c = write(i2c_fd, buffer, buffer_len);
+    auto write_c = device->write(buffer, buffer_len);
     if (write_c < 0) {
         std::cerr << "Unable to send command." << std::endl;
         // TODO - Have better exceptions.
@@ -152,6 +137,8 @@ uint8_t BMP280::read_id() {
 
 
 void BMP280::measure() {
+    TraceScope trace("BMP280", "measure");
+
     auto pressure_data = read_registers(0xf7, 3);
     uint8_t pressure_msb = pressure_data->at(0);
     uint8_t pressure_lsb = pressure_data->at(1);
@@ -166,8 +153,9 @@ void BMP280::measure() {
 
     uint32_t temp_val = (temp_msb << 12) | (temp_lsb << 4) | (temp_xlsb >> 4);
 
-    pressure = compensate_pressure(pressure_val);
+    // The pressure compensation depends on t_fine from the temperature compensation.
     temperature = compensate_temp(temp_val);
+    pressure = compensate_pressure(pressure_val);
 
     last_measurement = time(nullptr);
 }
@@ -205,3 +193,8 @@ double BMP280::get_temperature() {
 double BMP280::get_pressure() {
     return pressure;
 }
+
+void BMP280::sleep(std::chrono::milliseconds duration) {
+    TraceScope trace("BMP280", "sleep");
+    device->sleep(duration);
+}
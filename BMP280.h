@@ -1,6 +1,9 @@
 #ifndef IAQ_BMP280_H
 #define IAQ_BMP280_H
 
+#include "I2CDevice.h"
+
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
@@ -11,7 +14,7 @@ class BMP280 {
 public:
     BMP280(std::string i2c_dev_name, uint8_t ccs811_addr);
 
-    ~BMP280();
+    explicit BMP280(std::shared_ptr<I2CDevice> device);
 
     double get_pressure();
 
@@ -20,9 +23,7 @@ public:
     void measure();
 
 private:
-    const std::string i2c_dev_name;
-    const uint8_t ccs811_addr;
-    int i2c_fd = -1;
+    const std::shared_ptr<I2CDevice> device;
     time_t last_measurement = 0;
     double pressure;
     double temperature;
@@ -38,12 +39,8 @@ private:
 
     double compensate_pressure(int32_t adc_P);
 
-    void close_device();
-
     void init();
 
-    void open_device();
-
     void read_calibration_data();
 
     std::unique_ptr<std::vector<uint8_t>> read_registers(uint8_t start, size_t count);
@@ -54,6 +51,8 @@ private:
 
     void set_ctrl_meas(uint8_t val);
 
+    void sleep(std::chrono::milliseconds duration);
+
     void write_data(uint8_t *buffer, size_t buffer_len);
 };
 
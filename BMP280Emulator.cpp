@@ -0,0 +1,226 @@
+#include "BMP280Emulator.h"
+
+#include <cstring>
+
+// Calibration example from section 3.11.3 of the datasheet.
+static const uint16_t DIG_T1 = 27504;
+static const int16_t DIG_T2 = 26435, DIG_T3 = -1000;
+static const uint16_t DIG_P1 = 36477;
+static const int16_t DIG_P2 = -10685, DIG_P3 = 3024, DIG_P4 = 2855, DIG_P5 = 140, DIG_P6 = -7, DIG_P7 = 15500,
+        DIG_P8 = -14600, DIG_P9 = 6000;
+
+// Time needed to copy the NVM calibration data to the image registers after a reset.
+static const std::chrono::microseconds NVM_COPY_TIME(2000);
+
+// Output of a skipped measurement.
+static const int32_t ADC_SKIPPED = 0x80000;
+
+static const int32_t ADC_MAX = (1 << 20) - 1;
+
+static uint8_t oversampling(uint8_t osrs) {
+    static const uint8_t factor[] = {0, 1, 2, 4, 8, 16, 16, 16};
+    return factor[osrs & 7];
+}
+
+// Higher oversampling adds a bit of resolution each step, from 16 bit at x1 up to 20 bit at x16.
+static int32_t apply_resolution(int32_t adc, uint8_t osrs) {
+    switch (oversampling(osrs)) {
+        case 0:
+            return ADC_SKIPPED;
+        case 1:
+            return adc & ~0xF;
+        case 2:
+            return adc & ~0x7;
+        case 4:
+            return adc & ~0x3;
+        case 8:
+            return adc & ~0x1;
+        default:
+            return adc;
+    }
+}
+
+BMP280Emulator::BMP280Emulator(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz)
+        : EmulatedDevice(std::move(clock), bus_hz) {
+    reset();
+}
+
+void BMP280Emulator::set_temperature(double celsius) {
+    update();
+    temperature = celsius;
+}
+
+void BMP280Emulator::set_pressure(double hpa) {
+    update();
+    pressure = hpa;
+}
+
+std::chrono::microseconds BMP280Emulator::conversion_time(uint8_t osrs_t, uint8_t osrs_p) {
+    // Maximum measurement time from section 9 of the datasheet:
+    // 1.25 ms + 2.3 ms * T oversampling + (2.3 ms * P oversampling + 0.575 ms)
+    int64_t us = 1250 + 2300 * oversampling(osrs_t);
+    if (oversampling(osrs_p) != 0) us += 2300 * oversampling(osrs_p) + 575;
+    return std::chrono::microseconds(us);
+}
+
+std::chrono::microseconds BMP280Emulator::standby_time(uint8_t t_sb) {
+    static const int64_t standby_us[] = {500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000};
+    return std::chrono::microseconds(standby_us[t_sb & 7]);
+}
+
+void BMP280Emulator::reset() {
+    memset(registers, 0, sizeof(registers));
+    uint16_t calib[] = {DIG_T1, static_cast<uint16_t>(DIG_T2), static_cast<uint16_t>(DIG_T3),
+                        DIG_P1, static_cast<uint16_t>(DIG_P2), static_cast<uint16_t>(DIG_P3),
+                        static_cast<uint16_t>(DIG_P4), static_cast<uint16_t>(DIG_P5),
+                        static_cast<uint16_t>(DIG_P6), static_cast<uint16_t>(DIG_P7),
+                        static_cast<uint16_t>(DIG_P8), static_cast<uint16_t>(DIG_P9)};
+    for (size_t i = 0; i < 12; i++) {
+        registers[CALIB_START + 2 * i] = static_cast<uint8_t>(calib[i] & 0xFF);
+        registers[CALIB_START + 2 * i + 1] = static_cast<uint8_t>(calib[i] >> 8);
+    }
+    registers[ID] = 0x58;
+    registers[PRESS_MSB] = 0x80;
+    registers[TEMP_MSB] = 0x80;
+
+    nvm_copy_until = now() + NVM_COPY_TIME;
+    last_latched = std::chrono::microseconds(-1);
+    conversion_count = 0;
+}
+
+// Same floating point formulae as the driver, section 8.1 of the datasheet.
+double BMP280Emulator::compensate_temp(int32_t adc_t, int32_t &t_fine) const {
+    double var1 = (((double) adc_t) / 16384.0 - ((double) DIG_T1) / 1024.0) * ((double) DIG_T2);
+    double var2 = ((((double) adc_t) / 131072.0 - ((double) DIG_T1) / 8192.0) *
+                   (((double) adc_t) / 131072.0 - ((double) DIG_T1) / 8192.0)) * ((double) DIG_T3);
+    t_fine = static_cast<int32_t>(var1 + var2);
+    return t_fine / 5120.0;
+}
+
+double BMP280Emulator::compensate_pressure(int32_t adc_p, int32_t t_fine) const {
+    double var1 = ((double) t_fine / 2.0) - 64000.0;
+    double var2 = var1 * var1 * ((double) DIG_P6) / 32768.0;
+    var2 = var2 + var1 * ((double) DIG_P5) * 2.0;
+    var2 = (var2 / 4.0) + (((double) DIG_P4) * 65536.0);
+    var1 = (((double) DIG_P3) * var1 * var1 / 524288.0 + ((double) DIG_P2) * var1) / 524288.0;
+    var1 = (1.0 + var1 / 32768.0) * ((double) DIG_P1);
+    double p = 1048576.0 - (double) adc_p;
+    p = (p - (var2 / 4096.0)) * 6250.0 / var1;
+    var1 = ((double) DIG_P9) * p * p / 2147483648.0;
+    var2 = p * ((double) DIG_P8) / 32768.0;
+    return (p + (var1 + var2 + ((double) DIG_P7)) / 16.0) / 100;
+}
+
+// Converts the current environment into raw ADC values by inverting the compensation formulae.
+// Temperature rises and pressure falls monotonically with the ADC value, so bisection is enough.
+void BMP280Emulator::latch_conversion() {
+    int32_t t_fine = 0;
+    int32_t lo = 0, hi = ADC_MAX;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (compensate_temp(mid, t_fine) < temperature) lo = mid + 1; else hi = mid;
+    }
+    int32_t adc_t = lo;
+    compensate_temp(adc_t, t_fine);
+
+    lo = 0;
+    hi = ADC_MAX;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (compensate_pressure(mid, t_fine) > pressure) lo = mid + 1; else hi = mid;
+    }
+    int32_t adc_p = lo;
+
+    uint8_t ctrl_meas = registers[CTRL_MEAS];
+    adc_t = apply_resolution(adc_t, static_cast<uint8_t>(ctrl_meas >> 5));
+    adc_p = apply_resolution(adc_p, static_cast<uint8_t>((ctrl_meas >> 2) & 7));
+
+    registers[PRESS_MSB] = static_cast<uint8_t>(adc_p >> 12);
+    registers[PRESS_MSB + 1] = static_cast<uint8_t>((adc_p >> 4) & 0xFF);
+    registers[PRESS_MSB + 2] = static_cast<uint8_t>((adc_p & 0xF) << 4);
+    registers[TEMP_MSB] = static_cast<uint8_t>(adc_t >> 12);
+    registers[TEMP_MSB + 1] = static_cast<uint8_t>((adc_t >> 4) & 0xFF);
+    registers[TEMP_MSB + 2] = static_cast<uint8_t>((adc_t & 0xF) << 4);
+}
+
+// Completes the conversions that finished since the last bus access and updates the status bits.
+void BMP280Emulator::update() {
+    uint8_t ctrl_meas = registers[CTRL_MEAS];
+    auto t_conv = conversion_time(static_cast<uint8_t>(ctrl_meas >> 5), static_cast<uint8_t>((ctrl_meas >> 2) & 7));
+    bool measuring = false;
+
+    if (mode() == 3) {
+        auto period = t_conv + standby_time(static_cast<uint8_t>(registers[CONFIG] >> 5));
+        auto elapsed = now() - conversion_start;
+        if (elapsed >= t_conv) {
+            auto last_end = conversion_start + ((elapsed - t_conv) / period) * period + t_conv;
+            if (last_end > last_latched) {
+                auto first_end = conversion_start + t_conv;
+                conversion_count += last_latched < first_end ? (last_end - first_end) / period + 1
+                                                             : (last_end - last_latched) / period;
+                latch_conversion();
+                last_latched = last_end;
+            }
+        }
+        measuring = elapsed % period < t_conv;
+    } else if (mode() != 0) {
+        if (now() >= conversion_start + t_conv) {
+            latch_conversion();
+            conversion_count++;
+            last_latched = conversion_start + t_conv;
+            // Forced mode returns to sleep once the conversion is done.
+            registers[CTRL_MEAS] &= ~3;
+        } else {
+            measuring = true;
+        }
+    }
+
+    uint8_t status = 0;
+    if (measuring) status |= STATUS_MEASURING;
+    if (now() < nvm_copy_until) status |= STATUS_IM_UPDATE;
+    registers[STATUS] = status;
+}
+
+bool BMP280Emulator::on_read(uint8_t *buffer, size_t buffer_len) {
+    update();
+
+    // Burst reads auto-increment the register address and are served from shadow registers, so
+    // a conversion finishing during the read can't mix two samples.
+    for (size_t i = 0; i < buffer_len; i++) {
+        buffer[i] = registers[static_cast<uint8_t>(selected + i)];
+    }
+    return true;
+}
+
+// Writes are (register, value) pairs, a single byte only sets the register address for reading.
+bool BMP280Emulator::on_write(const uint8_t *buffer, size_t buffer_len) {
+    update();
+
+    if (buffer_len == 1) {
+        selected = buffer[0];
+        return true;
+    }
+
+    for (size_t i = 0; i + 1 < buffer_len; i += 2) {
+        uint8_t reg = buffer[i];
+        uint8_t value = buffer[i + 1];
+        switch (reg) {
+            case RESET:
+                if (value == 0xB6) reset();
+                break;
+            case CTRL_MEAS:
+                registers[CTRL_MEAS] = value;
+                conversion_start = now();
+                last_latched = std::chrono::microseconds(-1);
+                break;
+            case CONFIG:
+                registers[CONFIG] = value;
+                break;
+            default:
+                // Everything else is read-only.
+                break;
+        }
+    }
+    update();
+    return true;
+}
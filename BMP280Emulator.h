@@ -0,0 +1,74 @@
+#ifndef IAQ_BMP280EMULATOR_H
+#define IAQ_BMP280EMULATOR_H
+
+#include "Emulator.h"
+
+// Emulated BMP280 per specifications in
+// https://ae-bst.resource.bosch.com/media/_tech/media/datasheets/BST-BMP280-DS001.pdf
+//
+// Models sleep, forced and normal mode, the conversion time of every oversampling setting, the
+// standby time between conversions and the measuring / im_update bits of the status register.
+// The calibration data is the example set from the datasheet.
+class BMP280Emulator : public EmulatedDevice {
+public:
+    enum Register : uint8_t {
+        CALIB_START = 0x88,
+        ID = 0xD0,
+        RESET = 0xE0,
+        STATUS = 0xF3,
+        CTRL_MEAS = 0xF4,
+        CONFIG = 0xF5,
+        PRESS_MSB = 0xF7,
+        TEMP_MSB = 0xFA
+    };
+
+    enum StatusBits : uint8_t {
+        STATUS_IM_UPDATE = 1 << 0,
+        STATUS_MEASURING = 1 << 3
+    };
+
+    explicit BMP280Emulator(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz = DEFAULT_BUS_HZ);
+
+    // Environment sampled by the following conversions.
+    void set_temperature(double celsius);
+
+    void set_pressure(double hpa);
+
+    // Number of conversions completed since the last reset.
+    uint64_t get_conversion_count() const { return conversion_count; }
+
+    // Maximum conversion time for oversampling settings (osrs_t, osrs_p as written to ctrl_meas).
+    static std::chrono::microseconds conversion_time(uint8_t osrs_t, uint8_t osrs_p);
+
+    // Standby time for the t_sb setting of the config register.
+    static std::chrono::microseconds standby_time(uint8_t t_sb);
+
+protected:
+    bool on_read(uint8_t *buffer, size_t buffer_len) override;
+
+    bool on_write(const uint8_t *buffer, size_t buffer_len) override;
+
+private:
+    uint8_t registers[256] = {0};
+    uint8_t selected = ID;
+    double temperature = 25.0;
+    double pressure = 1013.25;
+    std::chrono::microseconds nvm_copy_until{0};
+    std::chrono::microseconds conversion_start{0};
+    std::chrono::microseconds last_latched{-1};
+    uint64_t conversion_count = 0;
+
+    uint8_t mode() const { return static_cast<uint8_t>(registers[CTRL_MEAS] & 3); }
+
+    double compensate_temp(int32_t adc_t, int32_t &t_fine) const;
+
+    double compensate_pressure(int32_t adc_p, int32_t t_fine) const;
+
+    void latch_conversion();
+
+    void reset();
+
+    void update();
+};
+
+#endif //IAQ_BMP280EMULATOR_H
@@ -1,22 +1,14 @@
 #include "CCS811.h"
-
-#include <fcntl.h>
-#include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
+#include "Trace.h"
 
 CCS811::CCS811(std::string i2c_dev_name, uint8_t ccs811_addr)
-        : i2c_dev_name(std::move(i2c_dev_name)),
-          ccs811_addr(ccs811_addr) {
-    open_device();
-    init();
-}
+        : CCS811(std::make_shared<LinuxI2CDevice>(std::move(i2c_dev_name), ccs811_addr)) {}
 
-CCS811::~CCS811() {
-    close_device();
+CCS811::CCS811(std::shared_ptr<I2CDevice> device)
+        : device(std::move(device)) {
+    init();
 }
 
-void CCS811::close_device() const { if (i2c_fd >= 0) close(i2c_fd); }
-
 uint16_t CCS811::get_co2() {
     return co2;
 }
@@ -26,6 +18,8 @@ uint16_t CCS811::get_tvoc() {
 }
 
 void CCS811::init() {
+    TraceScope trace("CCS811", "init");
+
     std::cout << "[CCS811] hecking the hardware id..." << std::endl;
     auto hw_id = read_mailbox(HW_ID);
     if (hw_id->front() != 0x81) {
@@ -38,7 +32,7 @@ void CCS811::init() {
     write_to_mailbox(SW_RESET, reset_sequence, 4);
 
     std::cout << "[CCS811] Sleeping for a second..." << std::endl;
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    sleep(std::chrono::seconds(1));
 
     auto hw_version = read_mailbox(HW_VERSION);
     char version_str[15];
@@ -56,27 +50,16 @@ void CCS811::init() {
     std::cout << "[CCS811] Starting..." << std::endl;
     uint8_t buffer[] = {APP_START};
     write_data(buffer, 1);
+    // The part doesn't respond until the application has started.
+    sleep(std::chrono::milliseconds(1));
 
     std::cout << "[CCS811] Configuring measurement mode to Mode 1 - Constant power mode, measuring every 1 sec."
               << std::endl;
-    uint8_t measurement_mode[] = {1 << 4};
-    write_to_mailbox(MEAS_MODE, measurement_mode, 1);
-}
-
-void CCS811::open_device() {
-    i2c_fd = open(i2c_dev_name.c_str(), O_RDWR);
-    if (i2c_fd < 0) {
-        std::cerr << "Unable to open" << i2c_dev_name << ". " << strerror(errno) << std::endl;
-        throw 1;
-    }
-
-    if (ioctl(i2c_fd, I2C_SLAVE, ccs811_addr) < 0) {
-        std::cerr << "Failed to communicate with the device. " << strerror(errno) << std::endl;
-        throw 1;
-    }
+    write_to_mailbox(MEAS_MODE, &meas_mode, 1);
 }
 
 std::unique_ptr<std::vector<uint8_t>> CCS811::read_mailbox(CCS811::Mailbox m) {
+    TraceScope trace("CCS811", "read_mailbox");
     auto mbox_info = mailbox_info(m);
 
     if (!mbox_info.readable) {
@@ -91,7 +74,7 @@ std::unique_ptr<std::vector<uint8_t>> CCS811::read_mailbox(CCS811::Mailbox m) {
 
     size_t buffer_len = mbox_info.size;
     auto *read_buffer = new uint8_t[buffer_len];
-    auto bytes_read = read(i2c_fd, read_buffer, buffer_len);
+    auto bytes_read = device->read(read_buffer, buffer_len);
     if (bytes_read != buffer_len) {
         std::cerr << "Failed to read from the device. Bytes read: " << bytes_read << std::endl;
         // TODO - Have better exceptions.
@@ -117,6 +100,8 @@ std::unique_ptr<std::vector<uint8_t>> CCS811::read_mailbox(CCS811::Mailbox m) {
 }
 
 void CCS811::read_sensors() {
+    TraceScope trace("CCS811", "measure");
+
     auto status = read_mailbox(STATUS);
     // Check if the sensor is ready for a read.
     if (!(status->front() & 8)) {
@@ -130,19 +115,23 @@ void CCS811::read_sensors() {
         return;
     }
 
+    read_alg_result();
+}
+
+bool CCS811::read_alg_result() {
     auto data = read_mailbox(ALG_RESULT_DATA);
     int status_byte = data->at(4);
     int err_byte = data->at(5);
 
     if (status_byte != 0x98) {
         std::cerr << "[CCS811] Sensor wasn't ready. Not updatingmeasurements." << std::endl;
-        return;
+        return false;
     }
 
     if (err_byte != 0) {
         std::cerr << "[CCS811] Error occurred while taking measurements. ERROR_ID: 0x" << std::hex << err_byte
                   << std::endl;
-        return;
+        return false;
     }
 
     co2 = (data->at(0) << 8) | data->at(1);
@@ -153,9 +142,12 @@ void CCS811::read_sensors() {
     tvoc &= ~(1 << 15);
 
     last_measurement = time(nullptr);
+    return true;
 }
 
 void CCS811::write_data(uint8_t *buffer, size_t buffer_len) {
+    TraceScope trace("CCS811", "write_data");
+
 #ifdef DBG
     std::cout << "Write: ";
      for (size_t i = 0; i < buffer_len; i++) {
@@ -164,7 +156,7 @@ void CCS811::write_data(uint8_t *buffer, size_t buffer_len) {
     std::cout << std::endl;
 #endif
 
-    auto write_c = write(i2c_fd, buffer, buffer_len);
+    auto write_c = device->write(buffer, buffer_len);
     if (write_c < 0) {
         std::cerr << "Unable to send command." << std::endl;
         // TODO - Have better exceptions.
@@ -188,7 +180,7 @@ void CCS811::write_to_mailbox(CCS811::Mailbox m, uint8_t *buffer, size_t buffer_
     auto write_buf_len = std::min(buffer_len, mbox_info.size) + 1;
     uint8_t write_buffer[write_buf_len];
     write_buffer[0] = mbox_info.id;
-    memcpy(&write_buffer[1], buffer, write_buf_len);
+    memcpy(&write_buffer[1], buffer, write_buf_len - 1);
     write_data(write_buffer, write_buf_len);
 }
 
@@ -207,3 +199,39 @@ void CCS811::set_env_data(double rel_humidity, double temperature) {
     write_to_mailbox(ENV_DATA, env_data, 4);
 }
 
+
+void CCS811::enable_threshold_interrupt(std::shared_ptr<AlertSource> alert_source, uint16_t low_to_med_co2,
+                                        uint16_t med_to_high_co2, uint8_t hysteresis) {
+    uint8_t thresholds[] = {static_cast<uint8_t>(low_to_med_co2 >> 8), static_cast<uint8_t>(low_to_med_co2 & 0xFF),
+                            static_cast<uint8_t>(med_to_high_co2 >> 8), static_cast<uint8_t>(med_to_high_co2 & 0xFF),
+                            hysteresis};
+    write_to_mailbox(THRESHOLDS, thresholds, 5);
+
+    alert = std::move(alert_source);
+    meas_mode |= INT_DATARDY | INT_THRESH;
+    write_to_mailbox(MEAS_MODE, &meas_mode, 1);
+}
+
+void CCS811::disable_threshold_interrupt() {
+    meas_mode &= ~(INT_DATARDY | INT_THRESH);
+    write_to_mailbox(MEAS_MODE, &meas_mode, 1);
+    alert.reset();
+}
+
+// Unlike read_sensors() this doesn't poll STATUS first: nINT means that new results are waiting
+// and ALG_RESULT_DATA carries its own copy of STATUS and ERROR_ID. Reading it releases nINT.
+bool CCS811::wait_for_threshold(std::chrono::milliseconds timeout) {
+    TraceScope trace("CCS811", "wait_for_threshold");
+
+    if (!alert) {
+        std::cerr << "[CCS811] Threshold interrupts aren't enabled." << std::endl;
+        return false;
+    }
+    if (!alert->wait(timeout)) return false;
+    return read_alg_result();
+}
+
+void CCS811::sleep(std::chrono::milliseconds duration) {
+    TraceScope trace("CCS811", "sleep");
+    device->sleep(duration);
+}
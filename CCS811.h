@@ -1,6 +1,10 @@
 #ifndef IAQ_CCS811_H
 #define IAQ_CCS811_H
 
+#include "AlertSource.h"
+#include "I2CDevice.h"
+
+#include <chrono>
 #include <cstring>
 #include <memory>
 #include <string>
@@ -16,7 +20,7 @@ class CCS811 {
 public:
     CCS811(std::string i2c_dev_name, uint8_t ccs811_addr);
 
-    ~CCS811();
+    explicit CCS811(std::shared_ptr<I2CDevice> device);
 
     void read_sensors();
 
@@ -26,6 +30,18 @@ public:
 
     void set_env_data(double rel_humidity, double temperature);
 
+    // Programs the eCO2 thresholds and enables interrupt-on-threshold: nINT is only asserted when
+    // eCO2 moves into another band (below low_to_med, up to med_to_high, above) by more than the
+    // hysteresis. alert is the source wired to nINT.
+    void enable_threshold_interrupt(std::shared_ptr<AlertSource> alert, uint16_t low_to_med_co2,
+                                    uint16_t med_to_high_co2, uint8_t hysteresis = 50);
+
+    void disable_threshold_interrupt();
+
+    // Waits for a threshold interrupt and reads the new results. Returns false if the timeout
+    // passed without an interrupt or the results couldn't be read.
+    bool wait_for_threshold(std::chrono::milliseconds timeout);
+
     struct MailboxInfo {
         uint8_t id;
         size_t size;
@@ -54,13 +70,19 @@ public:
         APP_START = 0xF4
     };
 
+    enum MeasModeBits : uint8_t {
+        INT_THRESH = 1 << 2,
+        INT_DATARDY = 1 << 3
+    };
+
 private:
-    const std::string i2c_dev_name;
-    const uint8_t ccs811_addr;
-    int i2c_fd = -1;
+    const std::shared_ptr<I2CDevice> device;
     time_t last_measurement = 0;
     uint16_t co2 = 0;
     uint16_t tvoc = 0;
+    // Drive mode 1, a measurement every second.
+    uint8_t meas_mode = 1 << 4;
+    std::shared_ptr<AlertSource> alert;
 
     MailboxInfo mailbox_info(Mailbox m) {
         // These values should correspond to the Mailbox values above.
@@ -100,7 +122,7 @@ private:
 
     void init();
 
-    void open_device();
+    bool read_alg_result();
 
     std::unique_ptr<std::vector<uint8_t>> read_mailbox(Mailbox m);
 
@@ -110,8 +132,7 @@ private:
 
     int version_to_str(uint8_t version, char *buffer);
 
-    void close_device() const;
+    void sleep(std::chrono::milliseconds duration);
 };
 
-
 #endif //IAQ_CCS811_H
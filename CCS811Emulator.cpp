@@ -0,0 +1,293 @@
+#include "CCS811Emulator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Boot and application start up times from the datasheet.
+static const std::chrono::microseconds RESET_TIME(2000);
+static const std::chrono::microseconds APP_START_TIME(1000);
+
+// Raw sensor reading reported with every sample: 20uA current, 500 ADC counts.
+static const uint16_t RAW_READING = (20 << 10) | 500;
+
+CCS811Emulator::CCS811Emulator(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz)
+        : EmulatedDevice(std::move(clock), bus_hz) {
+    reset();
+    busy_until = std::chrono::microseconds(0);
+}
+
+void CCS811Emulator::set_air_quality(uint16_t co2_ppm, uint16_t tvoc_ppb) {
+    update();
+    co2 = co2_ppm;
+    tvoc = tvoc_ppb;
+}
+
+void CCS811Emulator::inject_error(uint8_t error_bits) {
+    error_id |= error_bits;
+}
+
+std::chrono::microseconds CCS811Emulator::sample_period(uint8_t drive_mode) {
+    switch (drive_mode) {
+        case 1:
+            return std::chrono::seconds(1);
+        case 2:
+            return std::chrono::seconds(10);
+        case 3:
+            return std::chrono::seconds(60);
+        case 4:
+            return std::chrono::milliseconds(250);
+        default:
+            return std::chrono::microseconds(0);
+    }
+}
+
+void CCS811Emulator::reset() {
+    selected = STATUS;
+    app_mode = false;
+    meas_mode = 0;
+    error_id = 0;
+    data_ready = false;
+    sample_count = 0;
+    interrupt = false;
+    co2_band = -1;
+    busy_until = now() + RESET_TIME;
+}
+
+// Boot mode only exposes the registers needed to identify the part and start the application.
+bool CCS811Emulator::register_valid(uint8_t reg) const {
+    switch (reg) {
+        case STATUS:
+        case HW_ID:
+        case HW_VERSION:
+        case FW_BOOT_VERSION:
+        case FW_APP_VERSION:
+        case ERROR_ID:
+        case SW_RESET:
+            return true;
+        case APP_START:
+            return !app_mode;
+        case MEAS_MODE:
+        case ALG_RESULT_DATA:
+        case RAW_DATA:
+        case ENV_DATA:
+        case NTC:
+        case THRESHOLDS:
+        case BASELINE:
+            return app_mode;
+        default:
+            return false;
+    }
+}
+
+uint8_t CCS811Emulator::status() const {
+    uint8_t s = STATUS_APP_VALID;
+    if (app_mode) s |= STATUS_FW_MODE;
+    if (data_ready) s |= STATUS_DATA_READY;
+    if (error_id != 0) s |= STATUS_ERROR;
+    return s;
+}
+
+// Catches up with all the samples the part would have taken since the last bus access.
+void CCS811Emulator::update() {
+    auto drive_mode = static_cast<uint8_t>((meas_mode >> 4) & 7);
+    auto period = sample_period(drive_mode);
+    if (!app_mode || period.count() == 0 || now() < next_sample) return;
+
+    auto missed = (now() - next_sample) / period;
+    next_sample += period * (missed + 1);
+    sample_count += missed + 1;
+
+    // Mode 4 only produces raw data, the algorithm results are left untouched.
+    if (drive_mode != 4) {
+        alg_result[0] = static_cast<uint8_t>(co2 >> 8);
+        alg_result[1] = static_cast<uint8_t>(co2 & 0xFF);
+        alg_result[2] = static_cast<uint8_t>(tvoc >> 8);
+        alg_result[3] = static_cast<uint8_t>(tvoc & 0xFF);
+    }
+    raw_data[0] = static_cast<uint8_t>(RAW_READING >> 8);
+    raw_data[1] = static_cast<uint8_t>(RAW_READING & 0xFF);
+    data_ready = true;
+    update_interrupt();
+}
+
+// With INT_THRESH set nINT is only asserted when eCO2 moved into another band by more than the
+// hysteresis since the last interrupt, otherwise every new sample asserts it.
+void CCS811Emulator::update_interrupt() {
+    auto drive_mode = static_cast<uint8_t>((meas_mode >> 4) & 7);
+    if (!(meas_mode & INT_DATARDY) || drive_mode == 4) return;
+
+    if (!(meas_mode & INT_THRESH)) {
+        interrupt = true;
+        return;
+    }
+
+    uint16_t low_to_med = static_cast<uint16_t>((thresholds[0] << 8) | thresholds[1]);
+    uint16_t med_to_high = static_cast<uint16_t>((thresholds[2] << 8) | thresholds[3]);
+    uint8_t hysteresis = thresholds[4];
+    int band = co2 < low_to_med ? 0 : (co2 < med_to_high ? 1 : 2);
+    int delta = static_cast<int>(co2) - static_cast<int>(band_co2);
+    if (co2_band < 0 || (band != co2_band && std::abs(delta) > hysteresis)) {
+        if (co2_band >= 0 || first_threshold_interrupt) interrupt = true;
+        co2_band = band;
+        band_co2 = co2;
+    }
+}
+
+bool CCS811Emulator::interrupt_asserted() {
+    update();
+    return interrupt;
+}
+
+bool CCS811Emulator::on_read(uint8_t *buffer, size_t buffer_len) {
+    if (now() < busy_until) return false;
+    update();
+
+    uint8_t data[8] = {0};
+    size_t data_len = 0;
+    if (!register_valid(selected)) {
+        error_id |= READ_REG_INVALID;
+    } else {
+        switch (selected) {
+            case STATUS:
+                data[0] = status();
+                data_len = 1;
+                break;
+            case MEAS_MODE:
+                data[0] = meas_mode;
+                data_len = 1;
+                break;
+            case ALG_RESULT_DATA:
+                memcpy(data, alg_result, 4);
+                data[4] = status();
+                data[5] = error_id;
+                memcpy(&data[6], raw_data, 2);
+                data_len = 8;
+                data_ready = false;
+                interrupt = false;
+                break;
+            case RAW_DATA:
+                memcpy(data, raw_data, 2);
+                data_len = 2;
+                data_ready = false;
+                break;
+            case NTC:
+                // Equal reference and NTC voltages, i.e. the NTC is at its nominal resistance.
+                data[0] = 0x03;
+                data[1] = 0x00;
+                data[2] = 0x03;
+                data[3] = 0x00;
+                data_len = 4;
+                break;
+            case BASELINE:
+                memcpy(data, baseline, 2);
+                data_len = 2;
+                break;
+            case HW_ID:
+                data[0] = 0x81;
+                data_len = 1;
+                break;
+            case HW_VERSION:
+                data[0] = 0x12;
+                data_len = 1;
+                break;
+            case FW_BOOT_VERSION:
+                data[0] = 0x10;
+                data[1] = 0x00;
+                data_len = 2;
+                break;
+            case FW_APP_VERSION:
+                data[0] = 0x20;
+                data[1] = 0x00;
+                data_len = 2;
+                break;
+            case ERROR_ID:
+                data[0] = error_id;
+                data_len = 1;
+                error_id = 0;
+                break;
+            default:
+                error_id |= READ_REG_INVALID;
+                break;
+        }
+    }
+
+    memset(buffer, 0, buffer_len);
+    memcpy(buffer, data, std::min(buffer_len, data_len));
+    return true;
+}
+
+bool CCS811Emulator::on_write(const uint8_t *buffer, size_t buffer_len) {
+    if (now() < busy_until) return false;
+    if (buffer_len == 0) return true;
+    update();
+
+    selected = buffer[0];
+    if (!register_valid(selected)) {
+        error_id |= WRITE_REG_INVALID;
+        return true;
+    }
+    write_register(selected, &buffer[1], buffer_len - 1);
+    return true;
+}
+
+void CCS811Emulator::write_register(uint8_t reg, const uint8_t *data, size_t data_len) {
+    switch (reg) {
+        case MEAS_MODE: {
+            if (data_len < 1) return;
+            auto drive_mode = static_cast<uint8_t>((data[0] >> 4) & 7);
+            if (drive_mode > 4) {
+                error_id |= MEASMODE_INVALID;
+                return;
+            }
+            meas_mode = static_cast<uint8_t>(data[0] & 0x7C);
+            data_ready = false;
+            interrupt = false;
+            co2_band = -1;
+            sample_count = 0;
+            next_sample = now() + sample_period(drive_mode);
+            break;
+        }
+        case ENV_DATA:
+            memcpy(env_data, data, std::min(data_len, sizeof(env_data)));
+            break;
+        case THRESHOLDS:
+            memcpy(thresholds, data, std::min(data_len, sizeof(thresholds)));
+            break;
+        case BASELINE:
+            memcpy(baseline, data, std::min(data_len, sizeof(baseline)));
+            break;
+        case APP_START:
+            if (data_len != 0) return;
+            app_mode = true;
+            busy_until = now() + APP_START_TIME;
+            break;
+        case SW_RESET: {
+            static const uint8_t reset_sequence[] = {0x11, 0xe5, 0x72, 0x8a};
+            if (data_len >= 4 && memcmp(data, reset_sequence, 4) == 0) reset();
+            break;
+        }
+        default:
+            // A bare register address selects the register for the following read.
+            if (data_len != 0) error_id |= WRITE_REG_INVALID;
+            break;
+    }
+}
+
+EmulatedAlertSource::EmulatedAlertSource(std::shared_ptr<EmulatorClock> clock, std::shared_ptr<CCS811Emulator> ccs811)
+        : clock(std::move(clock)),
+          ccs811(std::move(ccs811)) {}
+
+bool EmulatedAlertSource::wait(std::chrono::milliseconds timeout) {
+    auto deadline = clock->now() + timeout;
+    while (!ccs811->interrupt_asserted()) {
+        auto next = ccs811->next_sample_time();
+        if (next <= clock->now() || next > deadline) {
+            // Nothing can assert the line before the deadline.
+            if (deadline > clock->now()) clock->advance(deadline - clock->now());
+            return ccs811->interrupt_asserted();
+        }
+        clock->advance(next - clock->now());
+    }
+    return true;
+}
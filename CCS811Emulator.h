@@ -0,0 +1,139 @@
+#ifndef IAQ_CCS811EMULATOR_H
+#define IAQ_CCS811EMULATOR_H
+
+#include "AlertSource.h"
+#include "Emulator.h"
+
+// Emulated CCS811 per specifications in
+// https://cdn.sparkfun.com/assets/learn_tutorials/1/4/3/CCS811_Datasheet-DS000459.pdf
+//
+// Models the boot/application firmware modes, the DATA_READY timing of each drive mode, the
+// ERROR_ID register and the nINT line including interrupt-on-threshold. Air quality values are set
+// by the test and sampled at every drive mode tick.
+class CCS811Emulator : public EmulatedDevice {
+public:
+    enum Register : uint8_t {
+        STATUS = 0x00,
+        MEAS_MODE = 0x01,
+        ALG_RESULT_DATA = 0x02,
+        RAW_DATA = 0x03,
+        ENV_DATA = 0x05,
+        NTC = 0x06,
+        THRESHOLDS = 0x10,
+        BASELINE = 0x11,
+        HW_ID = 0x20,
+        HW_VERSION = 0x21,
+        FW_BOOT_VERSION = 0x23,
+        FW_APP_VERSION = 0x24,
+        ERROR_ID = 0xE0,
+        APP_START = 0xF4,
+        SW_RESET = 0xFF
+    };
+
+    enum StatusBits : uint8_t {
+        STATUS_ERROR = 1 << 0,
+        STATUS_DATA_READY = 1 << 3,
+        STATUS_APP_VALID = 1 << 4,
+        STATUS_FW_MODE = 1 << 7
+    };
+
+    enum MeasModeBits : uint8_t {
+        INT_THRESH = 1 << 2,
+        INT_DATARDY = 1 << 3
+    };
+
+    enum ErrorBits : uint8_t {
+        WRITE_REG_INVALID = 1 << 0,
+        READ_REG_INVALID = 1 << 1,
+        MEASMODE_INVALID = 1 << 2,
+        MAX_RESISTANCE = 1 << 3,
+        HEATER_FAULT = 1 << 4,
+        HEATER_SUPPLY = 1 << 5
+    };
+
+    explicit CCS811Emulator(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz = DEFAULT_BUS_HZ);
+
+    // Values reported at the next sample.
+    void set_air_quality(uint16_t co2, uint16_t tvoc);
+
+    // Whether the first sample after enabling interrupt-on-threshold asserts nINT. The datasheet
+    // doesn't say; when disabled that sample only establishes the band. Enabled by default.
+    void set_first_threshold_interrupt(bool enabled) { first_threshold_interrupt = enabled; }
+
+    // Raises bits in ERROR_ID, e.g. to emulate a heater fault.
+    void inject_error(uint8_t error_bits);
+
+    bool in_app_mode() const { return app_mode; }
+
+    uint8_t get_meas_mode() const { return meas_mode; }
+
+    // Last ENV_DATA written by the host.
+    const uint8_t *get_env_data() const { return env_data; }
+
+    // State of the active low nINT line, true while asserted.
+    bool interrupt_asserted();
+
+    // When the next sample is due, i.e. the earliest time nINT can be asserted next.
+    std::chrono::microseconds next_sample_time() const { return next_sample; }
+
+    // Number of samples produced since the drive mode was last changed.
+    uint64_t get_sample_count() const { return sample_count; }
+
+    // Interval between samples for a drive mode, zero for idle and invalid modes.
+    static std::chrono::microseconds sample_period(uint8_t drive_mode);
+
+protected:
+    bool on_read(uint8_t *buffer, size_t buffer_len) override;
+
+    bool on_write(const uint8_t *buffer, size_t buffer_len) override;
+
+private:
+    uint8_t selected = STATUS;
+    bool app_mode = false;
+    uint8_t meas_mode = 0;
+    uint8_t error_id = 0;
+    bool data_ready = false;
+    std::chrono::microseconds busy_until{0};
+    std::chrono::microseconds next_sample{0};
+    uint64_t sample_count = 0;
+    bool interrupt = false;
+    // eCO2 band (0 low, 1 medium, 2 high) and value of the last threshold interrupt, -1 before the first.
+    int co2_band = -1;
+    uint16_t band_co2 = 0;
+    bool first_threshold_interrupt = true;
+
+    uint16_t co2 = 400;
+    uint16_t tvoc = 0;
+    uint8_t alg_result[4] = {0x01, 0x90, 0x00, 0x00};
+    uint8_t raw_data[2] = {0, 0};
+    uint8_t env_data[4] = {0x64, 0x00, 0x64, 0x00};
+    uint8_t thresholds[5] = {0x05, 0xDC, 0x09, 0xC4, 0x32};
+    uint8_t baseline[2] = {0, 0};
+
+    bool register_valid(uint8_t reg) const;
+
+    uint8_t status() const;
+
+    void update();
+
+    void update_interrupt();
+
+    void reset();
+
+    void write_register(uint8_t reg, const uint8_t *data, size_t data_len);
+};
+
+// nINT of an emulated CCS811. Waiting advances the virtual clock sample by sample until the line
+// is asserted or the timeout passes.
+class EmulatedAlertSource : public AlertSource {
+public:
+    EmulatedAlertSource(std::shared_ptr<EmulatorClock> clock, std::shared_ptr<CCS811Emulator> ccs811);
+
+    bool wait(std::chrono::milliseconds timeout) override;
+
+private:
+    const std::shared_ptr<EmulatorClock> clock;
+    const std::shared_ptr<CCS811Emulator> ccs811;
+};
+
+#endif //IAQ_CCS811EMULATOR_H
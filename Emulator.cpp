@@ -0,0 +1,39 @@
+#include "Emulator.h"
+
+#include <cerrno>
+
+const uint32_t EmulatedDevice::DEFAULT_BUS_HZ;
+
+EmulatedDevice::EmulatedDevice(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz)
+        : clock(std::move(clock)),
+          bus_hz(bus_hz) {}
+
+ssize_t EmulatedDevice::read(uint8_t *buffer, size_t buffer_len) {
+    transfer(buffer_len);
+    if (!on_read(buffer, buffer_len)) {
+        errno = ENXIO;
+        return -1;
+    }
+    return buffer_len;
+}
+
+ssize_t EmulatedDevice::write(const uint8_t *buffer, size_t buffer_len) {
+    transfer(buffer_len);
+    if (!on_write(buffer, buffer_len)) {
+        errno = ENXIO;
+        return -1;
+    }
+    return buffer_len;
+}
+
+void EmulatedDevice::sleep(std::chrono::microseconds duration) {
+    clock->advance(duration);
+}
+
+// Every byte takes 9 clocks (8 data bits and the ACK) plus the start and stop conditions.
+void EmulatedDevice::transfer(size_t buffer_len) {
+    transactions++;
+    bus_bytes += buffer_len + 1;
+    uint64_t bits = (buffer_len + 1) * 9 + 2;
+    clock->advance(std::chrono::microseconds((bits * 1000000 + bus_hz - 1) / bus_hz));
+}
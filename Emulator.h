@@ -0,0 +1,61 @@
+#ifndef IAQ_EMULATOR_H
+#define IAQ_EMULATOR_H
+
+#include "I2CDevice.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Virtual time shared by a set of emulated parts. Time only moves when a driver sleeps or
+// transfers bytes on the bus, which keeps runs against the emulators deterministic.
+class EmulatorClock {
+public:
+    std::chrono::microseconds now() const { return current; }
+
+    void advance(std::chrono::microseconds duration) { current += duration; }
+
+private:
+    std::chrono::microseconds current{0};
+};
+
+// Base class for the emulated sensors. It accounts for the time every transfer takes on the
+// bus and keeps traffic counters, the subclasses only model the register behavior of a part.
+class EmulatedDevice : public I2CDevice {
+public:
+    // Standard mode I2C.
+    static const uint32_t DEFAULT_BUS_HZ = 100000;
+
+    explicit EmulatedDevice(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz = DEFAULT_BUS_HZ);
+
+    ssize_t read(uint8_t *buffer, size_t buffer_len) override;
+
+    ssize_t write(const uint8_t *buffer, size_t buffer_len) override;
+
+    void sleep(std::chrono::microseconds duration) override;
+
+    // Number of read and write transactions that were attempted, including NACKed ones.
+    uint64_t get_transactions() const { return transactions; }
+
+    // Number of bytes on the bus, including the address byte of every transaction.
+    uint64_t get_bus_bytes() const { return bus_bytes; }
+
+    std::chrono::microseconds now() const { return clock->now(); }
+
+protected:
+    // Return false to NACK the transfer. Time on the clock already includes the transfer.
+    virtual bool on_read(uint8_t *buffer, size_t buffer_len) = 0;
+
+    virtual bool on_write(const uint8_t *buffer, size_t buffer_len) = 0;
+
+    const std::shared_ptr<EmulatorClock> clock;
+
+private:
+    const uint32_t bus_hz;
+    uint64_t transactions = 0;
+    uint64_t bus_bytes = 0;
+
+    void transfer(size_t buffer_len);
+};
+
+#endif //IAQ_EMULATOR_H
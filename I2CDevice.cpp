@@ -0,0 +1,48 @@
+#include "I2CDevice.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/i2c-dev.h>
+#include <thread>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+void I2CDevice::sleep(std::chrono::microseconds duration) {
+    std::this_thread::sleep_for(duration);
+}
+
+LinuxI2CDevice::LinuxI2CDevice(std::string i2c_dev_name, uint8_t addr)
+        : i2c_dev_name(std::move(i2c_dev_name)),
+          addr(addr) {
+    open_device();
+}
+
+LinuxI2CDevice::~LinuxI2CDevice() {
+    close_device();
+}
+
+void LinuxI2CDevice::close_device() {
+    if (i2c_fd >= 0) close(i2c_fd);
+}
+
+void LinuxI2CDevice::open_device() {
+    i2c_fd = open(i2c_dev_name.c_str(), O_RDWR);
+    if (i2c_fd < 0) {
+        std::cerr << "Unable to open" << i2c_dev_name << ". " << strerror(errno) << std::endl;
+        throw 1;
+    }
+
+    if (ioctl(i2c_fd, I2C_SLAVE, addr) < 0) {
+        std::cerr << "Failed to communicate with the device. " << strerror(errno) << std::endl;
+        throw 1;
+    }
+}
+
+ssize_t LinuxI2CDevice::read(uint8_t *buffer, size_t buffer_len) {
+    return ::read(i2c_fd, buffer, buffer_len);
+}
+
+ssize_t LinuxI2CDevice::write(const uint8_t *buffer, size_t buffer_len) {
+    return ::write(i2c_fd, buffer, buffer_len);
+}
@@ -0,0 +1,48 @@
+#ifndef IAQ_I2CDEVICE_H
+#define IAQ_I2CDEVICE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+// Byte level transport to a single I2C slave. The sensor drivers talk to the hardware only
+// through this interface so they can be run against emulated parts as well as /dev/i2c-*.
+class I2CDevice {
+public:
+    virtual ~I2CDevice() = default;
+
+    // Same contract as read(2): returns the number of bytes read, or -1 with errno set when
+    // the slave doesn't acknowledge.
+    virtual ssize_t read(uint8_t *buffer, size_t buffer_len) = 0;
+
+    // Same contract as write(2).
+    virtual ssize_t write(const uint8_t *buffer, size_t buffer_len) = 0;
+
+    // Waits for the part, e.g. while a conversion is running. Emulated devices advance their
+    // virtual clock instead of blocking.
+    virtual void sleep(std::chrono::microseconds duration);
+};
+
+// I2C slave behind the Linux i2c-dev interface.
+class LinuxI2CDevice : public I2CDevice {
+public:
+    LinuxI2CDevice(std::string i2c_dev_name, uint8_t addr);
+
+    ~LinuxI2CDevice() override;
+
+    ssize_t read(uint8_t *buffer, size_t buffer_len) override;
+
+    ssize_t write(const uint8_t *buffer, size_t buffer_len) override;
+
+private:
+    const std::string i2c_dev_name;
+    const uint8_t addr;
+    int i2c_fd = -1;
+
+    void close_device();
+
+    void open_device();
+};
+
+#endif //IAQ_I2CDEVICE_H
@@ -1,49 +1,40 @@
 #include "SI7021.h"
+#include "Trace.h"
 
-#include <fcntl.h>
 #include <unistd.h>
+#include <cmath>
 #include <cstring>
-#include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
 #include <iostream>
 #include <chrono>
 #include <thread>
 
 #undef DBG
 
+// Bits of the user register.
+static const uint8_t USER_REG_RESOLUTION_MASK = 0x81;
+static const uint8_t USER_REG_HEATER_ENABLE = 1 << 2;
+
 SI7021::SI7021(std::string i2c_dev_name, uint8_t ccs811_addr)
-        : i2c_dev_name(std::move(i2c_dev_name)),
-          ccs811_addr(ccs811_addr) {
-    open_device();
-    init();
-}
+        : SI7021(std::make_shared<LinuxI2CDevice>(std::move(i2c_dev_name), ccs811_addr)) {}
 
-SI7021::~SI7021() {
-    close_device();
+SI7021::SI7021(std::shared_ptr<I2CDevice> device)
+        : device(std::move(device)) {
+    init();
 }
 
-void SI7021::close_device() { if (i2c_fd >= 0) close(i2c_fd); }
-
 void SI7021::init() {
+    TraceScope trace("SI7021", "init");
+
     std::cout << "Resetting Si7021..." << std::endl;
     reset();
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    sleep(std::chrono::seconds(1));
 
     read_serial();
     read_fw_rev();
-}
 
-void SI7021::open_device() {
-    i2c_fd = open(i2c_dev_name.c_str(), O_RDWR);
-    if (i2c_fd < 0) {
-        std::cerr << "Unable to open" << i2c_dev_name << ". " << strerror(errno) << std::endl;
-        throw 1;
-    }
-
-    if (ioctl(i2c_fd, I2C_SLAVE, ccs811_addr) < 0) {
-        std::cerr << "Failed to communicate with the device. " << strerror(errno) << std::endl;
-        throw 1;
-    }
+    // The reset restores the default resolution and switches the heater off.
+    resolution = RH_12_BIT_TEMP_14_BIT;
+    heater_enabled = false;
 }
 
 uint64_t SI7021::get_serial() {
@@ -52,6 +43,8 @@ uint64_t SI7021::get_serial() {
 
 
 void SI7021::write_data(uint8_t *buffer, size_t buffer_len) {
+    TraceScope trace("SI7021", "write_data");
+
 #ifdef DBG
     std::cout << "Write: ";
      for (size_t i = 0; i < buffer_len; i++) {
@@ -60,7 +53,7 @@ void SI7021::write_data(uint8_t *buffer, size_t buffer_len) {
     std::cout << std::endl;
 #endif
 
-    auto write_c = write(i2c_fd, buffer, buffer_len);
+    auto write_c = device->write(buffer, buffer_len);
     if (write_c < 0) {
         std::cerr << "Unable to send command." << std::endl;
         // TODO - Have better exceptions.
@@ -72,13 +65,16 @@ void SI7021::write_data(uint8_t *buffer, size_t buffer_len) {
 }
 
 std::unique_ptr<std::vector<uint8_t>> SI7021::read_data(size_t buffer_size) {
+    TraceScope trace("SI7021", "read_data");
+
     auto *read_buffer = new uint8_t[buffer_size];
-    auto bytes_read = read(i2c_fd, read_buffer, buffer_size);
+    auto bytes_read = device->read(read_buffer, buffer_size);
 
 #ifdef DBG
     std::cout << "Read " << std::dec << bytes_read << " bytes" << std::endl;
 #endif
     if (bytes_read < 0) {
+        delete[] read_buffer;
         // return an empty vector if we can't read anything.
         return std::make_unique<std::vector<uint8_t>>();
     }
@@ -136,7 +132,7 @@ void SI7021::read_serial() {
 }
 
 void SI7021::read_fw_rev() {
-    uint8_t cmd[] = {0x84, 0x88};
+    uint8_t cmd[] = {0x84, 0xb8};
     write_data(cmd, 2);
     auto response = read_data(1);
 
@@ -147,24 +143,98 @@ uint8_t SI7021::get_fw_rev() {
     return fw_rev;
 }
 
+SI7021::Resolution SI7021::get_resolution() {
+    return resolution;
+}
+
+// Maximum conversion times from table 2 of the datasheet.
+std::chrono::microseconds SI7021::conversion_time(Resolution resolution, bool humidity) {
+    std::chrono::microseconds temp_time, rh_time;
+    switch (resolution) {
+        case RH_8_BIT_TEMP_12_BIT:
+            rh_time = std::chrono::microseconds(3100);
+            temp_time = std::chrono::microseconds(3800);
+            break;
+        case RH_10_BIT_TEMP_13_BIT:
+            rh_time = std::chrono::microseconds(4500);
+            temp_time = std::chrono::microseconds(6200);
+            break;
+        case RH_11_BIT_TEMP_11_BIT:
+            rh_time = std::chrono::microseconds(7000);
+            temp_time = std::chrono::microseconds(2400);
+            break;
+        default:
+            rh_time = std::chrono::microseconds(12000);
+            temp_time = std::chrono::microseconds(10800);
+            break;
+    }
+    return humidity ? rh_time + temp_time : temp_time;
+}
+
+void SI7021::set_resolution(SI7021::Resolution res) {
+    auto user_reg = read_user_register();
+    write_user_register(static_cast<uint8_t>((user_reg & ~USER_REG_RESOLUTION_MASK) | res));
+    resolution = res;
+}
+
+void SI7021::set_heater(bool enable, uint8_t heater_current) {
+    uint8_t cmd[] = {WRITE_HEATER_CONTROL_REG, static_cast<uint8_t>(heater_current & 0x0F)};
+    write_data(cmd, 2);
+
+    auto user_reg = read_user_register();
+    user_reg = enable ? (user_reg | USER_REG_HEATER_ENABLE) : (user_reg & ~USER_REG_HEATER_ENABLE);
+    write_user_register(user_reg);
+    heater_enabled = enable;
+}
+
+bool SI7021::is_heater_enabled() {
+    return heater_enabled;
+}
+
+uint8_t SI7021::read_user_register() {
+    uint8_t cmd[] = {READ_RHT_REG_1};
+    write_data(cmd, 1);
+    auto response = read_data(1);
+    if (response->empty()) {
+        std::cerr << "[SI7021] Unable to read the user register." << std::endl;
+        throw 1;
+    }
+    return response->front();
+}
+
+// Reserved bits have to keep their values, so callers pass in a value based on read_user_register().
+void SI7021::write_user_register(uint8_t value) {
+    uint8_t cmd[] = {WRITE_RHT_REG_1, value};
+    write_data(cmd, 2);
+}
+
 float SI7021::measure_humidity() {
+    TraceScope trace("SI7021", "measure");
+
     uint8_t cmd[] = {MEAS_REL_HUM};
     write_data(cmd, 1);
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    sleep(conversion_time(resolution, true));
 
     auto response = read_data(2);
-    if (response->empty()) return 0;
+    if (response->empty()) return NAN;
     uint16_t rh_code = (response->at(0) << 8) | response->at(1);
     return static_cast<float>(((125.0 * rh_code) / 65536) - 6);
 }
 
 float SI7021::measure_temperature() {
+    TraceScope trace("SI7021", "measure");
+
     uint8_t cmd[] = {MEAS_TEMP};
     write_data(cmd, 1);
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    sleep(conversion_time(resolution, false));
 
     auto response = read_data(2);
-    if (response->empty()) return 0;
+    if (response->empty()) return NAN;
     uint16_t temp_code = (response->at(0) << 8) | response->at(1);
     return static_cast<float>(((175.72 * temp_code) / 65536) - 46.85);
-}
\ No newline at end of file
+}
+
+void SI7021::sleep(std::chrono::microseconds duration) {
+    TraceScope trace("SI7021", "sleep");
+    device->sleep(duration);
+}
@@ -1,6 +1,9 @@
 #ifndef IAQ_SI7021_H
 #define IAQ_SI7021_H
 
+#include "I2CDevice.h"
+
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
@@ -10,7 +13,7 @@ class SI7021 {
 public:
     SI7021(std::string i2c_dev_name, uint8_t ccs811_addr);
 
-    ~SI7021();
+    explicit SI7021(std::shared_ptr<I2CDevice> device);
 
     enum Commands : uint8_t {
         MEAS_REL_HUM_HOLD = 0xe5,
@@ -25,8 +28,32 @@ public:
         READ_HEATER_CONTROL_REG = 0x11
     };
 
+    // Measurement resolution, encoded as the RES1 (bit 7) and RES0 (bit 0) bits of the user register.
+    // Lower resolutions convert faster, see conversion_time().
+    enum Resolution : uint8_t {
+        RH_12_BIT_TEMP_14_BIT = 0x00,
+        RH_8_BIT_TEMP_12_BIT = 0x01,
+        RH_10_BIT_TEMP_13_BIT = 0x80,
+        RH_11_BIT_TEMP_11_BIT = 0x81
+    };
+
     uint8_t get_fw_rev();
 
+    Resolution get_resolution();
+
+    void set_resolution(Resolution resolution);
+
+    // The heater dries the sensor after condensation. heater_current is the 4 bit setting of the
+    // heater control register, from 3.09 mA (0) up to 94.20 mA (15).
+    void set_heater(bool enable, uint8_t heater_current = 0);
+
+    bool is_heater_enabled();
+
+    // Worst case conversion time of a measurement at a resolution. A humidity measurement also
+    // measures the temperature, so it includes the temperature conversion time.
+    static std::chrono::microseconds conversion_time(Resolution resolution, bool humidity);
+
+    // Both return NaN if the part didn't deliver a result.
     float measure_humidity();
 
     float measure_temperature();
@@ -34,29 +61,31 @@ public:
     uint64_t get_serial();
 
 private:
-    const std::string i2c_dev_name;
-    const uint8_t ccs811_addr;
-    int i2c_fd = -1;
+    const std::shared_ptr<I2CDevice> device;
     uint64_t serial_no = 0;
     uint8_t fw_rev = 0;
+    Resolution resolution = RH_12_BIT_TEMP_14_BIT;
+    bool heater_enabled = false;
 
     uint8_t crc(uint8_t in);
 
-    void close_device();
-
     void init();
 
-    void open_device();
-
     std::unique_ptr<std::vector<uint8_t>> read_data(size_t buffer_size);
 
     void read_fw_rev();
 
     void read_serial();
 
+    uint8_t read_user_register();
+
     void reset();
 
+    void sleep(std::chrono::microseconds duration);
+
     void write_data(uint8_t *buffer, size_t buffer_len);
+
+    void write_user_register(uint8_t value);
 };
 
 #endif //IAQ_SI7021_H
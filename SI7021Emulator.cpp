@@ -0,0 +1,219 @@
+#include "SI7021Emulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Register reset values from section 6 of the datasheet.
+static const uint8_t USER_REGISTER_RESET = 0x3A;
+static const uint8_t HEATER_REGISTER_RESET = 0x00;
+
+// Only the resolution and heater enable bits of the user register can be written.
+static const uint8_t USER_REGISTER_WRITE_MASK = 0x85;
+
+// Power up time after a software reset.
+static const std::chrono::microseconds RESET_TIME(15000);
+
+static const uint8_t FIRMWARE_REVISION = 0x20;
+
+// Measurement bits per RES1:RES0 setting, see table 9 in the datasheet.
+static const uint8_t HUMIDITY_BITS[] = {12, 8, 10, 11};
+static const uint8_t TEMPERATURE_BITS[] = {14, 12, 13, 11};
+
+static uint16_t apply_resolution(uint16_t code, uint8_t bits) {
+    return static_cast<uint16_t>(code & ~((1 << (16 - bits)) - 1));
+}
+
+static uint16_t to_code(double value) {
+    return static_cast<uint16_t>(std::max(0.0, std::min(65535.0, std::round(value))));
+}
+
+SI7021Emulator::SI7021Emulator(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz, uint64_t serial)
+        : EmulatedDevice(std::move(clock), bus_hz),
+          serial(serial) {
+    reset();
+    busy_until = std::chrono::microseconds(0);
+}
+
+void SI7021Emulator::set_humidity(double rel_humidity) {
+    humidity = rel_humidity;
+}
+
+void SI7021Emulator::set_temperature(double celsius) {
+    temperature = celsius;
+}
+
+std::chrono::microseconds SI7021Emulator::humidity_conversion_time(uint8_t resolution) {
+    static const int64_t conversion_us[] = {12000, 3100, 4500, 7000};
+    return std::chrono::microseconds(conversion_us[resolution & 3]) + temperature_conversion_time(resolution);
+}
+
+std::chrono::microseconds SI7021Emulator::temperature_conversion_time(uint8_t resolution) {
+    static const int64_t conversion_us[] = {10800, 3800, 6200, 2400};
+    return std::chrono::microseconds(conversion_us[resolution & 3]);
+}
+
+uint8_t SI7021Emulator::crc8(const uint8_t *data, size_t data_len, uint8_t crc) {
+    for (size_t i = 0; i < data_len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+// RES1 is bit 7 and RES0 is bit 0 of the user register.
+uint8_t SI7021Emulator::resolution() const {
+    return static_cast<uint8_t>(((user_register >> 6) & 2) | (user_register & 1));
+}
+
+void SI7021Emulator::reset() {
+    user_register = USER_REGISTER_RESET;
+    heater_register = HEATER_REGISTER_RESET;
+    command = 0;
+    result_valid = false;
+    conversion_count = 0;
+    busy_until = now() + RESET_TIME;
+}
+
+// The environment is sampled when the conversion starts, the result becomes readable once the
+// conversion time for the current resolution has passed.
+void SI7021Emulator::start_conversion(bool humidity_measurement, bool hold) {
+    auto res = resolution();
+    auto temp_code = apply_resolution(to_code((temperature + 46.85) * 65536 / 175.72), TEMPERATURE_BITS[res]);
+    if (humidity_measurement) {
+        result_code = apply_resolution(to_code((humidity + 6) * 65536 / 125), HUMIDITY_BITS[res]);
+        last_temperature_code = temp_code;
+        conversion_done = now() + humidity_conversion_time(res);
+    } else {
+        result_code = temp_code;
+        conversion_done = now() + temperature_conversion_time(res);
+    }
+    hold_master = hold;
+    result_valid = true;
+    conversion_count++;
+}
+
+bool SI7021Emulator::on_write(const uint8_t *buffer, size_t buffer_len) {
+    if (now() < busy_until || buffer_len == 0) return false;
+    // The part doesn't acknowledge its address while a conversion is running.
+    if (now() < conversion_done && !hold_master) return false;
+
+    command = buffer[0];
+    switch (command) {
+        case 0xE5:
+            start_conversion(true, true);
+            return true;
+        case 0xF5:
+            start_conversion(true, false);
+            return true;
+        case 0xE3:
+            start_conversion(false, true);
+            return true;
+        case 0xF3:
+            start_conversion(false, false);
+            return true;
+        case 0xE0:
+        case 0xE7:
+        case 0x11:
+            return true;
+        case 0xFE:
+            reset();
+            return true;
+        case 0xE6:
+            if (buffer_len < 2) return false;
+            user_register = static_cast<uint8_t>((user_register & ~USER_REGISTER_WRITE_MASK) |
+                                                 (buffer[1] & USER_REGISTER_WRITE_MASK));
+            return true;
+        case 0x51:
+            if (buffer_len < 2) return false;
+            heater_register = static_cast<uint8_t>(buffer[1] & 0x0F);
+            return true;
+        case 0xFA:
+            return buffer_len >= 2 && buffer[1] == 0x0F;
+        case 0xFC:
+            return buffer_len >= 2 && buffer[1] == 0xC9;
+        case 0x84:
+            return buffer_len >= 2 && buffer[1] == 0xB8;
+        default:
+            command = 0;
+            return false;
+    }
+}
+
+// Fills data with the response to the last command and returns its size, zero NACKs the read.
+size_t SI7021Emulator::response(uint8_t *data) {
+    switch (command) {
+        case 0xE5:
+        case 0xF5:
+        case 0xE3:
+        case 0xF3:
+            if (!result_valid) return 0;
+            data[0] = static_cast<uint8_t>(result_code >> 8);
+            data[1] = static_cast<uint8_t>(result_code & 0xFF);
+            data[2] = crc8(data, 2);
+            return 3;
+        case 0xE0:
+            // No checksum is available for the temperature of the previous humidity measurement.
+            data[0] = static_cast<uint8_t>(last_temperature_code >> 8);
+            data[1] = static_cast<uint8_t>(last_temperature_code & 0xFF);
+            return 2;
+        case 0xE7:
+            data[0] = user_register;
+            return 1;
+        case 0x11:
+            data[0] = heater_register;
+            return 1;
+        case 0xFA: {
+            // SNA_3, CRC, SNA_2, CRC, SNA_1, CRC, SNA_0, CRC with a running checksum over the SNA bytes.
+            uint8_t crc = 0;
+            for (int i = 0; i < 4; i++) {
+                auto sna = static_cast<uint8_t>(serial >> (56 - 8 * i));
+                crc = crc8(&sna, 1, crc);
+                data[2 * i] = sna;
+                data[2 * i + 1] = crc;
+            }
+            return 8;
+        }
+        case 0xFC: {
+            // SNB_3, SNB_2, CRC, SNB_1, SNB_0, CRC with a running checksum over the SNB bytes.
+            uint8_t snb[4];
+            for (int i = 0; i < 4; i++) {
+                snb[i] = static_cast<uint8_t>(serial >> (24 - 8 * i));
+            }
+            data[0] = snb[0];
+            data[1] = snb[1];
+            data[2] = crc8(snb, 2);
+            data[3] = snb[2];
+            data[4] = snb[3];
+            data[5] = crc8(snb, 4);
+            return 6;
+        }
+        case 0x84:
+            data[0] = FIRMWARE_REVISION;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+bool SI7021Emulator::on_read(uint8_t *buffer, size_t buffer_len) {
+    if (now() < busy_until) return false;
+
+    if (now() < conversion_done) {
+        // The part NACKs its address while a "no hold master" conversion is running and
+        // stretches the clock until the end of the conversion otherwise.
+        if (!hold_master) return false;
+        clock->advance(conversion_done - now());
+    }
+
+    uint8_t data[8];
+    auto data_len = response(data);
+    if (data_len == 0) return false;
+
+    // The master can stop reading early, e.g. to skip the checksum. Extra bytes read as 0xFF.
+    memset(buffer, 0xFF, buffer_len);
+    memcpy(buffer, data, std::min(buffer_len, data_len));
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef IAQ_SI7021EMULATOR_H
+#define IAQ_SI7021EMULATOR_H
+
+#include "Emulator.h"
+
+// Emulated Si7021 per specifications in https://www.silabs.com/documents/public/data-sheets/Si7021-A20.pdf
+//
+// Models the conversion time of every resolution setting, NACKing reads while a "no hold master"
+// conversion is running, clock stretching for "hold master" conversions, the user and heater
+// registers and the checksum bytes of measurements and the electronic serial number.
+class SI7021Emulator : public EmulatedDevice {
+public:
+    explicit SI7021Emulator(std::shared_ptr<EmulatorClock> clock, uint32_t bus_hz = DEFAULT_BUS_HZ,
+                            uint64_t serial = 0x1122334415ffb5ffULL);
+
+    // Environment sampled by the following conversions.
+    void set_humidity(double rel_humidity);
+
+    void set_temperature(double celsius);
+
+    uint8_t get_user_register() const { return user_register; }
+
+    uint8_t get_heater_register() const { return heater_register; }
+
+    // Number of conversions started since the last reset.
+    uint64_t get_conversion_count() const { return conversion_count; }
+
+    // Maximum conversion times for the RES1:RES0 setting of the user register. A humidity
+    // measurement also converts the temperature, so it takes the sum of both.
+    static std::chrono::microseconds humidity_conversion_time(uint8_t resolution);
+
+    static std::chrono::microseconds temperature_conversion_time(uint8_t resolution);
+
+    // CRC-8 with polynomial x^8 + x^5 + x^4 + 1 and an initialization of 0x00.
+    static uint8_t crc8(const uint8_t *data, size_t data_len, uint8_t crc = 0);
+
+protected:
+    bool on_read(uint8_t *buffer, size_t buffer_len) override;
+
+    bool on_write(const uint8_t *buffer, size_t buffer_len) override;
+
+private:
+    const uint64_t serial;
+    double humidity = 50.0;
+    double temperature = 25.0;
+    uint8_t user_register = 0;
+    uint8_t heater_register = 0;
+    uint64_t conversion_count = 0;
+    std::chrono::microseconds busy_until{0};
+
+    uint8_t command = 0;
+    bool hold_master = false;
+    bool result_valid = false;
+    std::chrono::microseconds conversion_done{0};
+    uint16_t result_code = 0;
+    uint16_t last_temperature_code = 0;
+
+    uint8_t resolution() const;
+
+    void reset();
+
+    void start_conversion(bool humidity_measurement, bool hold);
+
+    size_t response(uint8_t *data);
+};
+
+#endif //IAQ_SI7021EMULATOR_H
@@ -0,0 +1,120 @@
+#include "SamplingLoop.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+static int64_t clock_ns(clockid_t clock_id) {
+    timespec ts{};
+    clock_gettime(clock_id, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+namespace {
+
+class SystemClock : public SamplingLoop::Clock {
+public:
+    int64_t monotonic_ns() override { return clock_ns(CLOCK_MONOTONIC); }
+
+    int64_t realtime_ns() override { return clock_ns(CLOCK_REALTIME); }
+
+    void sleep_until(int64_t deadline_ns) override {
+        timespec deadline{};
+        deadline.tv_sec = deadline_ns / 1000000000LL;
+        deadline.tv_nsec = deadline_ns % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR);
+    }
+};
+
+}
+
+SamplingLoop::SamplingLoop(Options options)
+        : SamplingLoop(options, std::make_shared<SystemClock>()) {}
+
+SamplingLoop::SamplingLoop(Options options, std::shared_ptr<Clock> clock)
+        : options(options),
+          clock(std::move(clock)),
+          period_ns(std::max<int64_t>(options.period.count(), 1)),
+          phase_tolerance_ns(std::max<int64_t>(options.phase_tolerance.count(), 0)) {
+    apply_scheduling();
+    align_to_wall_clock();
+}
+
+// Failures are reported but not fatal, the loop still works without real-time privileges.
+void SamplingLoop::apply_scheduling() {
+    if (options.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cerr << "[SamplingLoop] Unable to lock memory. " << strerror(errno) << std::endl;
+    }
+
+    if (options.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(options.cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+            std::cerr << "[SamplingLoop] Unable to pin to CPU " << options.cpu << "." << std::endl;
+        }
+    }
+
+    if (options.realtime_priority > 0) {
+        sched_param param{};
+        param.sched_priority = options.realtime_priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) {
+            std::cerr << "[SamplingLoop] Unable to switch to SCHED_FIFO. " << strerror(err) << std::endl;
+        }
+    }
+}
+
+// Picks the next deadline at a multiple of the period in wall-clock time and maps it onto the
+// monotonic clock, which the deadlines are kept on from then on.
+void SamplingLoop::align_to_wall_clock() {
+    auto realtime = clock->realtime_ns();
+    auto monotonic = clock->monotonic_ns();
+    auto next_grid_point = (realtime / period_ns + 1) * period_ns;
+    next_deadline_ns = monotonic + (next_grid_point - realtime);
+}
+
+SamplingLoop::Timestamp SamplingLoop::wait_next() {
+    auto now = clock->monotonic_ns();
+    if (now > next_deadline_ns) {
+        auto missed = (now - next_deadline_ns) / period_ns + 1;
+        stats.missed_deadlines += missed;
+        next_deadline_ns += missed * period_ns;
+    }
+
+    {
+        TraceScope trace("SamplingLoop", "sleep");
+        clock->sleep_until(next_deadline_ns);
+    }
+
+    Timestamp stamp{};
+    stamp.cycle = cycle++;
+    auto monotonic = clock->monotonic_ns();
+    auto realtime = clock->realtime_ns();
+    stamp.monotonic_ns = static_cast<uint64_t>(monotonic);
+    stamp.realtime_ns = static_cast<uint64_t>(realtime);
+
+    auto jitter = monotonic - next_deadline_ns;
+    stats.cycles++;
+    stats.last_jitter_ns = jitter;
+    stats.max_jitter_ns = std::max(stats.max_jitter_ns, jitter);
+    stats.total_jitter_ns += jitter;
+
+    // NTP slews both clocks alike, so the grid only drifts off when the wall clock is stepped.
+    // Any step beyond the tolerance is corrected by moving the next deadline back onto the grid.
+    auto phase = (realtime - jitter) % period_ns;
+    if (phase > period_ns / 2) phase -= period_ns;
+    next_deadline_ns += period_ns;
+    if (std::abs(phase) > phase_tolerance_ns) {
+        stats.realignments++;
+        next_deadline_ns -= phase;
+    }
+    return stamp;
+}
@@ -0,0 +1,85 @@
+#ifndef IAQ_SAMPLINGLOOP_H
+#define IAQ_SAMPLINGLOOP_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Paces the acquisition loop on absolute CLOCK_MONOTONIC deadlines, so the period doesn't stretch
+// by the time the work takes. Deadlines are aligned to multiples of the period in wall-clock time,
+// which puts every node with a synchronized clock on the same sampling grid.
+class SamplingLoop {
+public:
+    // Time source of the loop. The default one uses the system clocks, tests substitute their own.
+    class Clock {
+    public:
+        virtual ~Clock() = default;
+
+        virtual int64_t monotonic_ns() = 0;
+
+        virtual int64_t realtime_ns() = 0;
+
+        // Sleeps until the monotonic clock reaches deadline_ns.
+        virtual void sleep_until(int64_t deadline_ns) = 0;
+    };
+
+    struct Options {
+        std::chrono::nanoseconds period = std::chrono::seconds(1);
+        // How far wake ups may be off the wall-clock grid before the deadlines are moved back onto it.
+        std::chrono::nanoseconds phase_tolerance = std::chrono::milliseconds(2);
+        // SCHED_FIFO priority of the calling thread, 0 keeps the default scheduler.
+        int realtime_priority = 0;
+        // Locks all current and future pages in memory to avoid page faults on the sampling path.
+        bool lock_memory = false;
+        // CPU the calling thread is pinned to, -1 leaves the affinity alone.
+        int cpu = -1;
+    };
+
+    // When a cycle started, taken right after waking up.
+    struct Timestamp {
+        uint64_t cycle;
+        uint64_t monotonic_ns;
+        uint64_t realtime_ns;
+    };
+
+    struct Stats {
+        uint64_t cycles = 0;
+        // Deadlines that had already passed when the previous cycle finished.
+        uint64_t missed_deadlines = 0;
+        // Wake up latency relative to the deadline.
+        int64_t last_jitter_ns = 0;
+        int64_t max_jitter_ns = 0;
+        int64_t total_jitter_ns = 0;
+        // Times the deadlines were moved back onto the grid after the wall clock was stepped.
+        uint64_t realignments = 0;
+
+        int64_t mean_jitter_ns() const { return cycles ? total_jitter_ns / static_cast<int64_t>(cycles) : 0; }
+    };
+
+    // Applies the scheduling options to the calling thread, which has to be the one that calls
+    // wait_next().
+    explicit SamplingLoop(Options options);
+
+    SamplingLoop(Options options, std::shared_ptr<Clock> clock);
+
+    // Sleeps until the next deadline on the grid. Deadlines that already passed are skipped and
+    // counted as missed.
+    Timestamp wait_next();
+
+    const Stats &get_stats() const { return stats; }
+
+private:
+    const Options options;
+    const std::shared_ptr<Clock> clock;
+    const int64_t period_ns;
+    const int64_t phase_tolerance_ns;
+    int64_t next_deadline_ns = 0;
+    uint64_t cycle = 0;
+    Stats stats;
+
+    void align_to_wall_clock();
+
+    void apply_scheduling();
+};
+
+#endif //IAQ_SAMPLINGLOOP_H
@@ -0,0 +1,129 @@
+#include "SharedReadings.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+const uint32_t SharedReadingsSegment::MAGIC;
+const uint32_t SharedReadingsSegment::VERSION;
+const size_t SharedReadingsSegment::MAX_BOARDS;
+const size_t SharedReadingsSegment::READINGS_WORDS;
+const int SharedReadingsReader::MAX_READ_ATTEMPTS;
+
+SharedReadingsPublisher::SharedReadingsPublisher(std::string shm_name, size_t board_count)
+        : shm_name(std::move(shm_name)) {
+    if (board_count > SharedReadingsSegment::MAX_BOARDS) {
+        std::cerr << "[SharedReadings] Too many boards: " << board_count << std::endl;
+        throw 1;
+    }
+
+    // Start from a fresh segment so readers of a previous run can't mistake old data as current.
+    shm_unlink(this->shm_name.c_str());
+    int fd = shm_open(this->shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "[SharedReadings] Unable to create " << this->shm_name << ". " << strerror(errno) << std::endl;
+        throw 1;
+    }
+
+    if (ftruncate(fd, sizeof(SharedReadingsSegment)) < 0) {
+        std::cerr << "[SharedReadings] Unable to size " << this->shm_name << ". " << strerror(errno) << std::endl;
+        close(fd);
+        throw 1;
+    }
+
+    void *mem = mmap(nullptr, sizeof(SharedReadingsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        std::cerr << "[SharedReadings] Unable to map " << this->shm_name << ". " << strerror(errno) << std::endl;
+        throw 1;
+    }
+
+    // The segment is zero filled by ftruncate, i.e. every sequence starts out as 0 (no sample).
+    segment = static_cast<SharedReadingsSegment *>(mem);
+    segment->version = SharedReadingsSegment::VERSION;
+    segment->board_count = static_cast<uint32_t>(board_count);
+    segment->slot_size = sizeof(SharedReadingsSegment::Slot);
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = SharedReadingsSegment::MAGIC;
+}
+
+SharedReadingsPublisher::~SharedReadingsPublisher() {
+    if (segment != nullptr) munmap(segment, sizeof(SharedReadingsSegment));
+    shm_unlink(shm_name.c_str());
+}
+
+void SharedReadingsPublisher::publish(size_t board, const BoardReadings &readings) {
+    if (board >= segment->board_count) return;
+
+    uint32_t words[SharedReadingsSegment::READINGS_WORDS] = {0};
+    memcpy(words, &readings, sizeof(readings));
+
+    auto &slot = segment->slots[board];
+    auto sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < SharedReadingsSegment::READINGS_WORDS; i++) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+SharedReadingsReader::SharedReadingsReader(std::string shm_name)
+        : shm_name(std::move(shm_name)) {
+    int fd = shm_open(this->shm_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "[SharedReadings] Unable to open " << this->shm_name << ". " << strerror(errno) << std::endl;
+        throw 1;
+    }
+
+    void *mem = mmap(nullptr, sizeof(SharedReadingsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        std::cerr << "[SharedReadings] Unable to map " << this->shm_name << ". " << strerror(errno) << std::endl;
+        throw 1;
+    }
+
+    segment = static_cast<const SharedReadingsSegment *>(mem);
+    if (segment->magic != SharedReadingsSegment::MAGIC || segment->version != SharedReadingsSegment::VERSION ||
+        segment->slot_size != sizeof(SharedReadingsSegment::Slot)) {
+        std::cerr << "[SharedReadings] " << this->shm_name << " has an unsupported layout." << std::endl;
+        munmap(const_cast<SharedReadingsSegment *>(segment), sizeof(SharedReadingsSegment));
+        segment = nullptr;
+        throw 1;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+SharedReadingsReader::~SharedReadingsReader() {
+    if (segment != nullptr) munmap(const_cast<SharedReadingsSegment *>(segment), sizeof(SharedReadingsSegment));
+}
+
+size_t SharedReadingsReader::get_board_count() const {
+    return segment->board_count;
+}
+
+bool SharedReadingsReader::read(size_t board, BoardReadings &readings) const {
+    if (board >= segment->board_count) return false;
+
+    auto &slot = segment->slots[board];
+    uint32_t words[SharedReadingsSegment::READINGS_WORDS];
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+        auto before = slot.sequence.load(std::memory_order_acquire);
+        if (before == 0) return false;
+        // An update is in progress. A publisher that died here leaves the sequence odd for good.
+        if (before & 1) continue;
+
+        for (size_t i = 0; i < SharedReadingsSegment::READINGS_WORDS; i++) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+
+        memcpy(&readings, words, sizeof(readings));
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+#ifndef IAQ_SHAREDREADINGS_H
+#define IAQ_SHAREDREADINGS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Latest processed sample set of one board.
+struct BoardReadings {
+    uint64_t sample_no;
+    // CLOCK_MONOTONIC and CLOCK_REALTIME at the time of the sample.
+    uint64_t monotonic_ns;
+    uint64_t realtime_ns;
+    double bmp280_temperature;
+    double bmp280_pressure;
+    float si7021_temperature;
+    float si7021_humidity;
+    uint16_t ccs811_co2;
+    uint16_t ccs811_tvoc;
+    uint32_t reserved;
+};
+
+// Layout of the POSIX shared memory segment. Every board has its own seqlock: the writer makes
+// the sequence odd while it updates the readings and even again once they are consistent.
+// Readings are stored as relaxed 32 bit atomic words so that torn reads are well defined, readers
+// simply retry when the sequence changed under them.
+struct SharedReadingsSegment {
+    static const uint32_t MAGIC = 0x49415131; // "IAQ1"
+    static const uint32_t VERSION = 1;
+    static const size_t MAX_BOARDS = 64;
+    static const size_t READINGS_WORDS = (sizeof(BoardReadings) + 3) / 4;
+
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> sequence;
+        std::atomic<uint32_t> words[READINGS_WORDS];
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t board_count;
+    uint32_t slot_size;
+    Slot slots[MAX_BOARDS];
+};
+
+// Owned by the acquisition daemon. Publishing never blocks or waits for readers.
+class SharedReadingsPublisher {
+public:
+    SharedReadingsPublisher(std::string shm_name, size_t board_count);
+
+    ~SharedReadingsPublisher();
+
+    void publish(size_t board, const BoardReadings &readings);
+
+private:
+    const std::string shm_name;
+    SharedReadingsSegment *segment = nullptr;
+};
+
+// Lock-free, syscall-free access to the latest readings from any local process.
+//
+// A restarted publisher replaces the segment with a new one, so a reader that mapped the old
+// segment keeps seeing the last readings of the previous run. Long running readers should compare
+// monotonic_ns against CLOCK_MONOTONIC and reopen the segment once the readings are stale.
+class SharedReadingsReader {
+public:
+    // Number of attempts read() makes to get a consistent snapshot before giving up.
+    static const int MAX_READ_ATTEMPTS = 1000;
+
+    explicit SharedReadingsReader(std::string shm_name);
+
+    ~SharedReadingsReader();
+
+    size_t get_board_count() const;
+
+    // Copies a consistent snapshot of a board's readings. Returns false if nothing was published
+    // for the board yet, or if no consistent snapshot was seen within MAX_READ_ATTEMPTS, e.g.
+    // because the publisher died in the middle of an update.
+    bool read(size_t board, BoardReadings &readings) const;
+
+private:
+    const std::string shm_name;
+    const SharedReadingsSegment *segment = nullptr;
+};
+
+#endif //IAQ_SHAREDREADINGS_H
@@ -0,0 +1,439 @@
+#include "SubscriptionServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+const uint32_t SampleFrame::MAGIC;
+const size_t SubscriptionServer::MAX_FRAME_SIZE;
+const size_t SubscriptionServer::PENDING_CAPACITY;
+
+// Frames handed to the kernel with a single sendmsg() call.
+static const size_t MAX_IOVECS = 64;
+
+// Clients that send this much without a newline are disconnected.
+static const size_t MAX_INPUT_SIZE = 1024;
+
+SubscriptionServer::SubscriptionServer(std::string socket_path, size_t client_queue_size, int client_send_buffer)
+        : socket_path(std::move(socket_path)),
+          // Dropping the oldest frame needs room for the partially written one and a new one.
+          client_queue_size(std::max<size_t>(client_queue_size, 2)),
+          client_send_buffer(client_send_buffer) {}
+
+SubscriptionServer::~SubscriptionServer() {
+    stop();
+}
+
+void SubscriptionServer::start() {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "[SubscriptionServer] Socket path is too long: " << socket_path << std::endl;
+        throw 1;
+    }
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        std::cerr << "[SubscriptionServer] Unable to create socket. " << strerror(errno) << std::endl;
+        throw 1;
+    }
+
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+        std::cerr << "[SubscriptionServer] Unable to listen on " << socket_path << ". " << strerror(errno)
+                  << std::endl;
+        throw 1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (epoll_fd < 0 || event_fd < 0 || spare_fd < 0) {
+        std::cerr << "[SubscriptionServer] Unable to set up epoll. " << strerror(errno) << std::endl;
+        throw 1;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.fd = event_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+
+    running = true;
+    server_thread = std::thread(&SubscriptionServer::run, this);
+}
+
+void SubscriptionServer::stop() {
+    if (running.exchange(false)) {
+        uint64_t one = 1;
+        write(event_fd, &one, sizeof(one));
+        server_thread.join();
+    }
+
+    for (auto &entry : clients) {
+        close(entry.first);
+    }
+    clients.clear();
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        listen_fd = -1;
+    }
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (event_fd >= 0) close(event_fd);
+    if (spare_fd >= 0) close(spare_fd);
+    epoll_fd = -1;
+    event_fd = -1;
+    spare_fd = -1;
+    accept_paused = false;
+}
+
+void SubscriptionServer::publish(size_t board, const BoardReadings &readings) {
+    if (!running.load(std::memory_order_relaxed)) return;
+
+    auto tail = pending_tail.load(std::memory_order_relaxed);
+    if (tail - pending_head.load(std::memory_order_acquire) >= PENDING_CAPACITY) return;
+
+    pending[tail % PENDING_CAPACITY] = {static_cast<uint32_t>(board), readings};
+    pending_tail.store(tail + 1, std::memory_order_release);
+
+    uint64_t one = 1;
+    write(event_fd, &one, sizeof(one));
+}
+
+void SubscriptionServer::run() {
+    epoll_event events[64];
+    while (running.load(std::memory_order_relaxed)) {
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "[SubscriptionServer] epoll_wait failed. " << strerror(errno) << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                accept_clients();
+                continue;
+            }
+            if (fd == event_fd) {
+                uint64_t count;
+                read(event_fd, &count, sizeof(count));
+                drain_pending();
+                continue;
+            }
+
+            auto it = clients.find(fd);
+            if (it == clients.end()) continue;
+            auto &client = *it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                close_client(client);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                handle_input(client);
+                // handle_input() may have closed the client.
+                if (clients.find(fd) == clients.end()) continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !flush(client)) {
+                close_client(client);
+            }
+        }
+    }
+}
+
+void SubscriptionServer::accept_clients() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                // The connection stays in the backlog and listen_fd stays readable, so returning
+                // here would spin. Turn the client away instead.
+                if (reject_client()) continue;
+                return;
+            }
+            // EAGAIN once the backlog is empty.
+            return;
+        }
+
+        if (client_send_buffer > 0) {
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &client_send_buffer, sizeof(client_send_buffer));
+        }
+
+        std::unique_ptr<Client> client(new Client());
+        client->fd = fd;
+        client->queue.resize(client_queue_size);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        clients[fd] = std::move(client);
+    }
+}
+
+// Accepts and immediately closes a connection while out of file descriptors, using the spare one.
+// Returns false once the backlog is empty, accept4() reports EMFILE before it looks at the backlog.
+bool SubscriptionServer::reject_client() {
+    bool rejected = false;
+    if (spare_fd >= 0) {
+        close(spare_fd);
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            close(fd);
+            rejected = true;
+            std::cerr << "[SubscriptionServer] Out of file descriptors, rejected a client." << std::endl;
+        }
+        spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (spare_fd >= 0) return rejected;
+    }
+
+    // Something else took the spare descriptor. Stop accepting until a client disconnects.
+    std::cerr << "[SubscriptionServer] Out of file descriptors, not accepting clients." << std::endl;
+    set_accept_interest(false);
+    return false;
+}
+
+void SubscriptionServer::set_accept_interest(bool enable) {
+    if (accept_paused == !enable) return;
+    accept_paused = !enable;
+
+    if (enable) {
+        if (spare_fd < 0) spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    } else {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+    }
+}
+
+void SubscriptionServer::close_client(Client &client) {
+    int fd = client.fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(fd);
+    set_accept_interest(true);
+}
+
+void SubscriptionServer::handle_input(Client &client) {
+    char buffer[256];
+    while (true) {
+        auto bytes_read = read(client.fd, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close_client(client);
+            return;
+        }
+        if (bytes_read == 0) {
+            close_client(client);
+            return;
+        }
+        client.input.append(buffer, static_cast<size_t>(bytes_read));
+    }
+
+    size_t newline;
+    while ((newline = client.input.find('\n')) != std::string::npos) {
+        parse_subscription(client, client.input.substr(0, newline));
+        client.input.erase(0, newline + 1);
+    }
+    if (client.input.size() > MAX_INPUT_SIZE) close_client(client);
+}
+
+void SubscriptionServer::parse_subscription(Client &client, const std::string &line) {
+    std::istringstream tokens(line);
+    std::string token;
+    if (!(tokens >> token) || token != "SUBSCRIBE") return;
+
+    Subscription subscription;
+    while (tokens >> token) {
+        auto eq = token.find('=');
+        if (eq == std::string::npos) continue;
+        auto key = token.substr(0, eq);
+        auto value = token.substr(eq + 1);
+        if (key == "boards") {
+            subscription.boards = strtoull(value.c_str(), nullptr, 0);
+        } else if (key == "sensors") {
+            subscription.sensors = static_cast<uint16_t>(strtoul(value.c_str(), nullptr, 0) & ALL_SENSORS);
+        } else if (key == "interval_ms") {
+            subscription.interval_ns = strtoull(value.c_str(), nullptr, 0) * 1000000ULL;
+        } else if (key == "format") {
+            subscription.json = value == "json";
+        }
+    }
+
+    client.subscribed = true;
+    client.subscription = subscription;
+    memset(client.last_sent_ns, 0, sizeof(client.last_sent_ns));
+}
+
+void SubscriptionServer::drain_pending() {
+    auto head = pending_head.load(std::memory_order_relaxed);
+    auto tail = pending_tail.load(std::memory_order_acquire);
+    for (; head != tail; head++) {
+        fan_out(pending[head % PENDING_CAPACITY]);
+    }
+    pending_head.store(head, std::memory_order_release);
+
+    // Flush once per batch so every client gets all its new frames in one sendmsg() call.
+    std::vector<int> failed;
+    for (auto &entry : clients) {
+        auto &client = *entry.second;
+        if (client.count == 0 || client.waiting_for_writable) continue;
+        if (!flush(client)) failed.push_back(entry.first);
+    }
+    for (auto fd : failed) {
+        close_client(*clients[fd]);
+    }
+}
+
+void SubscriptionServer::fan_out(const Pending &sample) {
+    if (sample.board >= SharedReadingsSegment::MAX_BOARDS) return;
+
+    for (auto &entry : clients) {
+        auto &client = *entry.second;
+        auto &subscription = client.subscription;
+        if (!client.subscribed || !(subscription.boards & (1ULL << sample.board))) continue;
+
+        auto &last_sent = client.last_sent_ns[sample.board];
+        if (last_sent != 0 && sample.readings.monotonic_ns < last_sent + subscription.interval_ns) continue;
+        last_sent = sample.readings.monotonic_ns;
+
+        if (client.count == client.queue.size()) {
+            // Drop the oldest frame. A partially written frame has to go out first to keep the
+            // stream intact, so it's moved over the frame that gets dropped.
+            if (client.head_offset > 0) {
+                client.queue[(client.head + 1) % client.queue.size()] = client.queue[client.head];
+            }
+            client.head = (client.head + 1) % client.queue.size();
+            client.count--;
+            client.dropped++;
+            dropped_frames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        auto &frame = client.queue[(client.head + client.count) % client.queue.size()];
+        frame.size = static_cast<uint16_t>(format_frame(client, sample, frame.data));
+        client.count++;
+    }
+}
+
+size_t SubscriptionServer::format_frame(const Client &client, const Pending &sample, char *data) {
+    auto sensors = client.subscription.sensors;
+    auto &r = sample.readings;
+
+    if (!client.subscription.json) {
+        SampleFrame frame{};
+        frame.magic = SampleFrame::MAGIC;
+        frame.board = static_cast<uint16_t>(sample.board);
+        frame.sensors = sensors;
+        frame.sample_no = r.sample_no;
+        frame.monotonic_ns = r.monotonic_ns;
+        frame.realtime_ns = r.realtime_ns;
+        if (sensors & BMP280_TEMPERATURE) frame.bmp280_temperature = r.bmp280_temperature;
+        if (sensors & BMP280_PRESSURE) frame.bmp280_pressure = r.bmp280_pressure;
+        if (sensors & SI7021_TEMPERATURE) frame.si7021_temperature = r.si7021_temperature;
+        if (sensors & SI7021_HUMIDITY) frame.si7021_humidity = r.si7021_humidity;
+        if (sensors & CCS811_CO2) frame.ccs811_co2 = r.ccs811_co2;
+        if (sensors & CCS811_TVOC) frame.ccs811_tvoc = r.ccs811_tvoc;
+        memcpy(data, &frame, sizeof(frame));
+        return sizeof(frame);
+    }
+
+    size_t len = 0;
+    auto append = [&](const char *format, auto... args) {
+        if (len >= MAX_FRAME_SIZE) return;
+        int written = snprintf(data + len, MAX_FRAME_SIZE - len, format, args...);
+        if (written > 0) len = std::min(MAX_FRAME_SIZE - 1, len + static_cast<size_t>(written));
+    };
+    append("{\"board\":%u,\"sample_no\":%llu,\"monotonic_ns\":%llu,\"realtime_ns\":%llu", sample.board,
+           static_cast<unsigned long long>(r.sample_no), static_cast<unsigned long long>(r.monotonic_ns),
+           static_cast<unsigned long long>(r.realtime_ns));
+    // Missing readings are NaN, which JSON can't represent.
+    auto append_reading = [&](const char *name, double value) {
+        if (std::isfinite(value)) append(",\"%s\":%.2f", name, value); else append(",\"%s\":null", name);
+    };
+    if (sensors & BMP280_TEMPERATURE) append_reading("bmp280_temperature", r.bmp280_temperature);
+    if (sensors & BMP280_PRESSURE) append_reading("bmp280_pressure", r.bmp280_pressure);
+    if (sensors & SI7021_TEMPERATURE) append_reading("si7021_temperature", r.si7021_temperature);
+    if (sensors & SI7021_HUMIDITY) append_reading("si7021_humidity", r.si7021_humidity);
+    if (sensors & CCS811_CO2) append(",\"ccs811_co2\":%u", static_cast<unsigned>(r.ccs811_co2));
+    if (sensors & CCS811_TVOC) append(",\"ccs811_tvoc\":%u", static_cast<unsigned>(r.ccs811_tvoc));
+    append("}\n");
+    return len;
+}
+
+// Writes as much of the client's queue as the socket takes. Returns false if the client is gone.
+bool SubscriptionServer::flush(Client &client) {
+    while (client.count > 0) {
+        iovec iov[MAX_IOVECS];
+        size_t iov_count = std::min(client.count, MAX_IOVECS);
+        for (size_t i = 0; i < iov_count; i++) {
+            auto &frame = client.queue[(client.head + i) % client.queue.size()];
+            size_t offset = i == 0 ? client.head_offset : 0;
+            iov[i].iov_base = frame.data + offset;
+            iov[i].iov_len = frame.size - offset;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+        auto written = sendmsg(client.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                set_writable_interest(client, true);
+                return true;
+            }
+            return false;
+        }
+
+        auto remaining = static_cast<size_t>(written);
+        while (remaining > 0) {
+            auto &frame = client.queue[client.head];
+            auto left = frame.size - client.head_offset;
+            if (remaining < left) {
+                client.head_offset += remaining;
+                break;
+            }
+            remaining -= left;
+            client.head_offset = 0;
+            client.head = (client.head + 1) % client.queue.size();
+            client.count--;
+        }
+    }
+
+    set_writable_interest(client, false);
+    return true;
+}
+
+void SubscriptionServer::set_writable_interest(Client &client, bool enable) {
+    if (client.waiting_for_writable == enable) return;
+    client.waiting_for_writable = enable;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | (enable ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    ev.data.fd = client.fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &ev);
+}
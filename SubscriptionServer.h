@@ -0,0 +1,158 @@
+#ifndef IAQ_SUBSCRIPTIONSERVER_H
+#define IAQ_SUBSCRIPTIONSERVER_H
+
+#include "SharedReadings.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Fixed-size binary frame streamed to subscribers. Fields of unsubscribed sensors are zero.
+struct SampleFrame {
+    static const uint32_t MAGIC = 0x49415146; // "IAQF"
+
+    uint32_t magic;
+    uint16_t board;
+    // Sensors bits of the fields that are set.
+    uint16_t sensors;
+    uint64_t sample_no;
+    uint64_t monotonic_ns;
+    uint64_t realtime_ns;
+    double bmp280_temperature;
+    double bmp280_pressure;
+    double si7021_temperature;
+    double si7021_humidity;
+    uint16_t ccs811_co2;
+    uint16_t ccs811_tvoc;
+    uint32_t reserved;
+};
+
+// Streams samples to local clients over a Unix domain socket.
+//
+// Clients send a line of the form
+//   SUBSCRIBE boards=<mask> sensors=<mask> interval_ms=<ms> format=<binary|json>
+// with every key optional (defaults: all boards, all sensors, every sample, binary), and can
+// resubscribe at any time. Nothing is sent before the first SUBSCRIBE line. Binary subscribers receive SampleFrame structs, JSON subscribers one
+// object per line.
+//
+// The server runs single-threaded on epoll in its own thread. publish() only hands the sample
+// over through a lock-free queue, so the acquisition loop never waits for subscribers. Every
+// client has a bounded queue of frames, when a slow client falls behind its oldest frames are
+// dropped.
+class SubscriptionServer {
+public:
+    enum Sensors : uint16_t {
+        BMP280_TEMPERATURE = 1 << 0,
+        BMP280_PRESSURE = 1 << 1,
+        SI7021_TEMPERATURE = 1 << 2,
+        SI7021_HUMIDITY = 1 << 3,
+        CCS811_CO2 = 1 << 4,
+        CCS811_TVOC = 1 << 5,
+        ALL_SENSORS = 0x3F
+    };
+
+    static const size_t MAX_FRAME_SIZE = 384;
+
+    // client_send_buffer sets SO_SNDBUF of client sockets in bytes, 0 keeps the system default. A
+    // smaller kernel buffer makes the per-client queue, and thus drops, kick in sooner.
+    SubscriptionServer(std::string socket_path, size_t client_queue_size = 64, int client_send_buffer = 0);
+
+    ~SubscriptionServer();
+
+    void start();
+
+    void stop();
+
+    // Called from the acquisition loop. Never blocks, samples are dropped if the server thread
+    // can't keep up.
+    void publish(size_t board, const BoardReadings &readings);
+
+    // Frames dropped from the queues of slow clients so far.
+    uint64_t get_dropped_frames() const { return dropped_frames.load(std::memory_order_relaxed); }
+
+private:
+    struct Subscription {
+        uint64_t boards = ~0ULL;
+        uint16_t sensors = ALL_SENSORS;
+        uint64_t interval_ns = 0;
+        bool json = false;
+    };
+
+    struct Frame {
+        uint16_t size;
+        char data[MAX_FRAME_SIZE];
+    };
+
+    struct Client {
+        int fd;
+        bool subscribed = false;
+        Subscription subscription;
+        std::string input;
+        std::vector<Frame> queue;
+        size_t head = 0;
+        size_t count = 0;
+        // Bytes of the frame at the head of the queue that were already written.
+        size_t head_offset = 0;
+        bool waiting_for_writable = false;
+        uint64_t dropped = 0;
+        uint64_t last_sent_ns[SharedReadingsSegment::MAX_BOARDS] = {0};
+    };
+
+    struct Pending {
+        uint32_t board;
+        BoardReadings readings;
+    };
+
+    static const size_t PENDING_CAPACITY = 256;
+
+    const std::string socket_path;
+    const size_t client_queue_size;
+    const int client_send_buffer;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int event_fd = -1;
+    // Kept open so that a connection can still be accepted and closed when the process is out of
+    // file descriptors. Otherwise it would stay in the backlog and keep listen_fd readable.
+    int spare_fd = -1;
+    // Set when listen_fd was taken out of epoll because not even the spare descriptor helped.
+    bool accept_paused = false;
+    std::thread server_thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> dropped_frames{0};
+    std::unordered_map<int, std::unique_ptr<Client>> clients;
+
+    // Single producer (acquisition loop), single consumer (server thread) queue.
+    Pending pending[PENDING_CAPACITY];
+    std::atomic<size_t> pending_head{0};
+    std::atomic<size_t> pending_tail{0};
+
+    void accept_clients();
+
+    bool reject_client();
+
+    void set_accept_interest(bool enable);
+
+    void close_client(Client &client);
+
+    void drain_pending();
+
+    void fan_out(const Pending &sample);
+
+    size_t format_frame(const Client &client, const Pending &sample, char *data);
+
+    void handle_input(Client &client);
+
+    void parse_subscription(Client &client, const std::string &line);
+
+    void run();
+
+    void set_writable_interest(Client &client, bool enable);
+
+    bool flush(Client &client);
+};
+
+#endif //IAQ_SUBSCRIPTIONSERVER_H
@@ -0,0 +1,113 @@
+#include "TemperatureFusion.h"
+
+#include <cmath>
+
+namespace {
+
+struct Noise {
+    double r_si;
+    double r_bmp;
+    double q_t;
+    double q_b;
+    double offset;
+};
+
+// Kept out of the class so the arrays can be __restrict parameters: the state vectors never alias
+// each other or the readings, and without that promise the compiler would need more runtime
+// overlap checks than it is willing to emit and keeps the loop scalar.
+void update_boards(size_t n, Noise noise, const double *__restrict z_si_in, const double *__restrict z_bmp_in,
+                   const double *__restrict ready, double *__restrict t, double *__restrict b,
+                   double *__restrict c00, double *__restrict c01, double *__restrict c11) {
+    // Missing readings and uninitialized boards get a zero gain instead of a branch. The selects
+    // only pick between loaded values and constants, which the compiler can if-convert; a select
+    // around arithmetic or a conditional load would keep the loop scalar.
+    for (size_t i = 0; i < n; i++) {
+        double a00 = c00[i] + noise.q_t;
+        double a01 = c01[i];
+        double a11 = c11[i] + noise.q_b;
+        double x_t = t[i];
+        double x_b = b[i];
+
+        // Si7021: z = T + offset
+        double z_si = z_si_in[i];
+        double weight = ready[i];
+        bool has_si = z_si == z_si;
+        double valid_si = has_si ? weight : 0.0;
+        double y = valid_si * ((has_si ? z_si : 0.0) - noise.offset - x_t);
+        double s = a00 + noise.r_si;
+        double k0 = valid_si * a00 / s;
+        double k1 = valid_si * a01 / s;
+        x_t += k0 * y;
+        x_b += k1 * y;
+        a11 -= k1 * a01;
+        a01 -= k0 * a01;
+        a00 -= k0 * a00;
+
+        // BMP280: z = T + bias
+        double z_bmp = z_bmp_in[i];
+        bool has_bmp = z_bmp == z_bmp;
+        double valid_bmp = has_bmp ? weight : 0.0;
+        y = valid_bmp * ((has_bmp ? z_bmp : 0.0) - x_t - x_b);
+        double ph0 = a00 + a01;
+        double ph1 = a01 + a11;
+        s = ph0 + ph1 + noise.r_bmp;
+        k0 = valid_bmp * ph0 / s;
+        k1 = valid_bmp * ph1 / s;
+        x_t += k0 * y;
+        x_b += k1 * y;
+        a00 -= k0 * ph0;
+        a01 -= k0 * ph1;
+        a11 -= k1 * ph1;
+
+        t[i] = x_t;
+        b[i] = x_b;
+        c00[i] = a00;
+        c01[i] = a01;
+        c11[i] = a11;
+    }
+}
+
+}
+
+TemperatureFusion::TemperatureFusion(size_t boards)
+        : TemperatureFusion(boards, Params()) {}
+
+TemperatureFusion::TemperatureFusion(size_t boards, Params params)
+        : params(params),
+          temperature(boards, NAN),
+          bias(boards, NAN),
+          p00(boards, 0.0),
+          p01(boards, 0.0),
+          p11(boards, 0.0),
+          initialized(boards, 0.0) {}
+
+// Boards start from their first complete pair of readings, until then their state is NaN. The
+// bias is completely unknown at that point, so it starts with a wide variance and is learned from
+// the following readings.
+void TemperatureFusion::initialize(const double *si7021_temperature, const double *bmp280_temperature) {
+    double r_si = params.si7021_noise * params.si7021_noise;
+    double r_bmp = params.bmp280_noise * params.bmp280_noise;
+    for (size_t i = 0; i < temperature.size(); i++) {
+        if (initialized[i] != 0.0 || std::isnan(si7021_temperature[i]) || std::isnan(bmp280_temperature[i])) continue;
+        temperature[i] = si7021_temperature[i] - params.si7021_offset;
+        bias[i] = bmp280_temperature[i] - temperature[i];
+        p00[i] = r_si;
+        p01[i] = -r_si;
+        p11[i] = r_si + r_bmp + 1.0;
+        initialized[i] = 1.0;
+    }
+}
+
+void TemperatureFusion::update(const double *si7021_temperature, const double *bmp280_temperature,
+                               double dt_seconds) {
+    Noise noise;
+    noise.r_si = params.si7021_noise * params.si7021_noise;
+    noise.r_bmp = params.bmp280_noise * params.bmp280_noise;
+    noise.q_t = params.temperature_drift * params.temperature_drift * dt_seconds;
+    noise.q_b = params.bias_drift * params.bias_drift * dt_seconds;
+    noise.offset = params.si7021_offset;
+
+    update_boards(temperature.size(), noise, si7021_temperature, bmp280_temperature, initialized.data(),
+                  temperature.data(), bias.data(), p00.data(), p01.data(), p11.data());
+    initialize(si7021_temperature, bmp280_temperature);
+}
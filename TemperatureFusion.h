@@ -0,0 +1,62 @@
+#ifndef IAQ_TEMPERATUREFUSION_H
+#define IAQ_TEMPERATUREFUSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fuses the Si7021 and BMP280 temperatures of each board with a two state Kalman filter:
+// the ambient temperature and the bias of the BMP280 relative to the Si7021. The bias, e.g. from
+// the BMP280 sitting closer to a warm part of the board, is learned online. Only the relative bias
+// is observable, a known offset of the Si7021 itself can be configured.
+//
+// The filter state of all boards is kept as a structure of arrays and updated in one branch free
+// pass that the compiler vectorizes across boards.
+class TemperatureFusion {
+public:
+    struct Params {
+        // Standard deviation of the measurement noise in °C.
+        double si7021_noise = 0.1;
+        double bmp280_noise = 0.2;
+        // How fast the ambient temperature and the bias can change, in °C per sqrt(s).
+        double temperature_drift = 0.1;
+        double bias_drift = 0.001;
+        // Self-heating offset of the Si7021 reading in °C, subtracted from its measurements.
+        double si7021_offset = 0.0;
+    };
+
+    explicit TemperatureFusion(size_t boards);
+
+    TemperatureFusion(size_t boards, Params params);
+
+    // Advances all boards by dt_seconds and folds in one reading per board. A NaN reading is
+    // treated as missing.
+    void update(const double *si7021_temperature, const double *bmp280_temperature, double dt_seconds);
+
+    // NaN until the board had a reading from both sensors at the same time.
+    double get_temperature(size_t board) const { return temperature[board]; }
+
+    double get_bmp280_bias(size_t board) const { return bias[board]; }
+
+    // Variance of the fused temperature in °C².
+    double get_variance(size_t board) const { return p00[board]; }
+
+    size_t size() const { return temperature.size(); }
+
+private:
+    const Params params;
+
+    // Per board state and the symmetric 2x2 covariance matrix [p00 p01; p01 p11].
+    std::vector<double> temperature;
+    std::vector<double> bias;
+    std::vector<double> p00;
+    std::vector<double> p01;
+    std::vector<double> p11;
+    // 1.0 once the board has been initialized, 0.0 before. A double so the update loop can use it
+    // as a gain mask without a conversion.
+    std::vector<double> initialized;
+
+    void initialize(const double *si7021_temperature, const double *bmp280_temperature);
+};
+
+#endif //IAQ_TEMPERATUREFUSION_H
@@ -0,0 +1,146 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+const size_t Trace::BUFFER_CAPACITY;
+std::atomic<bool> Trace::is_enabled(false);
+
+namespace {
+
+// Ring buffer slot. The fields are relaxed atomics because an exporting thread may copy a slot
+// while its owner overwrites it; such copies are detected and dropped through head.
+struct Slot {
+    std::atomic<const char *> category{nullptr};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<uint64_t> begin_ns{0};
+    std::atomic<uint64_t> end_ns{0};
+};
+
+// Single-writer ring buffer owned by one thread. The owner publishes an event by storing the
+// slot first and bumping head afterwards, readers use head to find the valid window.
+struct ThreadBuffer {
+    explicit ThreadBuffer(uint32_t tid) : tid(tid) {}
+
+    const uint32_t tid;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> start{0};
+    Slot events[Trace::BUFFER_CAPACITY];
+};
+
+std::mutex registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+
+// Buffers are shared with the registry so that events survive the thread that recorded them.
+ThreadBuffer &thread_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffer = std::make_shared<ThreadBuffer>(static_cast<uint32_t>(registry.size() + 1));
+        registry.push_back(buffer);
+    }
+    return *buffer;
+}
+
+void write_json_string(std::ostream &out, const char *str) {
+    out << '"';
+    for (const char *c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+void write_us(std::ostream &out, uint64_t ns) {
+    auto fill = out.fill('0');
+    out << ns / 1000 << '.' << std::setw(3) << ns % 1000;
+    out.fill(fill);
+}
+
+}
+
+void Trace::record(const char *category, const char *name, uint64_t begin_ns, uint64_t end_ns) {
+    auto &buffer = thread_buffer();
+    auto head = buffer.head.load(std::memory_order_relaxed);
+    auto &slot = buffer.events[head % BUFFER_CAPACITY];
+    // Orders the previous head update before the slot stores, so an exporter that sees any of
+    // them also sees head and knows the slot is being overwritten.
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.category.store(category, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+    slot.end_ns.store(end_ns, std::memory_order_relaxed);
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::clear() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto &buffer : registry) {
+        buffer->start.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+void Trace::write_chrome_json(std::ostream &out) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffers = registry;
+    }
+
+    // The numbers have to be decimal whatever the caller's stream is set to.
+    auto flags = out.flags(std::ios::dec);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<Event> events;
+    for (auto &buffer : buffers) {
+        auto head = buffer->head.load(std::memory_order_acquire);
+        auto begin = std::max(buffer->start.load(std::memory_order_relaxed),
+                              head > BUFFER_CAPACITY ? head - BUFFER_CAPACITY : 0);
+        events.clear();
+        for (auto i = begin; i < head; i++) {
+            auto &slot = buffer->events[i % BUFFER_CAPACITY];
+            events.push_back({slot.category.load(std::memory_order_relaxed),
+                              slot.name.load(std::memory_order_relaxed),
+                              slot.begin_ns.load(std::memory_order_relaxed),
+                              slot.end_ns.load(std::memory_order_relaxed)});
+        }
+
+        // Slots the owner overwrote while we were copying are not trustworthy, drop them. That
+        // includes index new_head - BUFFER_CAPACITY, whose slot may be in the middle of a write.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto new_head = buffer->head.load(std::memory_order_relaxed);
+        auto overwritten = new_head >= BUFFER_CAPACITY ? new_head - BUFFER_CAPACITY + 1 : 0;
+        size_t skip = overwritten > begin ? std::min<size_t>(overwritten - begin, events.size()) : 0;
+
+        if (!first) out << ',';
+        first = false;
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"thread-" << buffer->tid << "\"}}";
+
+        for (size_t i = skip; i < events.size(); i++) {
+            auto &e = events[i];
+            out << ",{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid << ",\"cat\":";
+            write_json_string(out, e.category);
+            out << ",\"name\":";
+            write_json_string(out, e.name);
+            out << ",\"ts\":";
+            write_us(out, e.begin_ns);
+            out << ",\"dur\":";
+            write_us(out, e.end_ns - e.begin_ns);
+            out << '}';
+        }
+    }
+    out << "]}" << std::endl;
+    out.flags(flags);
+}
+
+bool Trace::write_chrome_json(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) return false;
+    write_chrome_json(out);
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,75 @@
+#ifndef IAQ_TRACE_H
+#define IAQ_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Low-overhead recorder for timing driver operations. Every thread appends complete
+// (begin, end) events to its own fixed-size ring buffer, so recording never takes a lock.
+// When tracing is disabled a TraceScope costs a single relaxed atomic load.
+//
+// The recorded events can be exported in the Chrome trace-event JSON format, which can
+// be opened in https://ui.perfetto.dev or chrome://tracing.
+class Trace {
+public:
+    // Number of events kept per thread. Older events are overwritten once a buffer is full.
+    static const size_t BUFFER_CAPACITY = 16384;
+
+    struct Event {
+        const char *category;
+        const char *name;
+        uint64_t begin_ns;
+        uint64_t end_ns;
+    };
+
+    static bool enabled() { return is_enabled.load(std::memory_order_relaxed); }
+
+    static void set_enabled(bool enable) { is_enabled.store(enable, std::memory_order_relaxed); }
+
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Appends an event to the calling thread's buffer. category and name must point to
+    // strings that outlive the trace (string literals in practice).
+    static void record(const char *category, const char *name, uint64_t begin_ns, uint64_t end_ns);
+
+    // Drops all recorded events.
+    static void clear();
+
+    // Writes the recorded events as Chrome trace-event JSON. Events that are being recorded
+    // while the export runs may be missed, so disable tracing first for a complete picture.
+    static void write_chrome_json(std::ostream &out);
+
+    static bool write_chrome_json(const std::string &path);
+
+private:
+    static std::atomic<bool> is_enabled;
+};
+
+// Records the lifetime of the enclosing scope as a single trace event.
+class TraceScope {
+public:
+    TraceScope(const char *category, const char *name)
+            : category(category), name(name), active(Trace::enabled()), begin_ns(active ? Trace::now() : 0) {}
+
+    ~TraceScope() {
+        if (active) Trace::record(category, name, begin_ns, Trace::now());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *category;
+    const char *name;
+    const bool active;
+    const uint64_t begin_ns;
+};
+
+#endif //IAQ_TRACE_H
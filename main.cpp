@@ -1,32 +1,183 @@
+#include "Archive.h"
 #include "BMP280.h"
 #include "CCS811.h"
+#include "SamplingLoop.h"
+#include "SharedReadings.h"
 #include "SI7021.h"
+#include "SubscriptionServer.h"
+#include "TemperatureFusion.h"
+#include "Trace.h"
 
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
 #include <iomanip>
 
+// SIGUSR1 toggles trace recording. The trace is written out when recording is switched off.
+static volatile std::sig_atomic_t trace_toggle_requested = 0;
+
+static void on_sigusr1(int) { trace_toggle_requested = 1; }
+
+static void handle_trace_toggle(const char *trace_path) {
+    if (!trace_toggle_requested) return;
+    trace_toggle_requested = 0;
+
+    Trace::set_enabled(!Trace::enabled());
+    if (Trace::enabled()) {
+        std::cout << "[Trace] Recording started." << std::endl;
+        return;
+    }
+
+    if (Trace::write_chrome_json(trace_path)) {
+        std::cout << "[Trace] Wrote " << trace_path << std::endl;
+    } else {
+        std::cerr << "[Trace] Unable to write " << trace_path << std::endl;
+    }
+    Trace::clear();
+}
+
+// SIGTERM and SIGINT end the loop, so that the archive gets closed and the index written.
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int) { stop_requested = 1; }
+
+static int env_int(const char *name, int default_value) {
+    const char *value = getenv(name);
+    return value != nullptr ? atoi(value) : default_value;
+}
+
 int main() {
+    // IAQ_TRACE=<file> records from startup; recording can be toggled later with SIGUSR1.
+    const char *trace_path = getenv("IAQ_TRACE");
+    if (trace_path != nullptr) {
+        Trace::set_enabled(true);
+    } else {
+        trace_path = "iaq_trace.json";
+    }
+    signal(SIGUSR1, on_sigusr1);
+    signal(SIGTERM, on_stop_signal);
+    signal(SIGINT, on_stop_signal);
+
     CCS811 ccs811("/dev/i2c-1", 0x5b);
     SI7021 si7021("/dev/i2c-1", 0x40);
     BMP280 bmp280("/dev/i2c-1", 0x76);
 
-    while (true) {
-        ccs811.read_sensors();
+    // IAQ_CCS811_INT_GPIO=<gpio> switches the CCS811 to interrupt-on-threshold: it is only read when
+    // nINT reports that eCO2 moved into another band (IAQ_CO2_LOW_TO_MED, IAQ_CO2_MED_TO_HIGH), and
+    // polled every IAQ_CCS811_FALLBACK_S seconds in case an edge is missed.
+    bool ccs811_threshold_mode = getenv("IAQ_CCS811_INT_GPIO") != nullptr;
+    if (ccs811_threshold_mode) {
+        auto alert = std::make_shared<GpioAlertSource>(static_cast<unsigned>(env_int("IAQ_CCS811_INT_GPIO", 0)));
+        ccs811.enable_threshold_interrupt(alert, static_cast<uint16_t>(env_int("IAQ_CO2_LOW_TO_MED", 1500)),
+                                          static_cast<uint16_t>(env_int("IAQ_CO2_MED_TO_HIGH", 2500)));
+    }
+    auto ccs811_fallback_cycles = static_cast<uint64_t>(std::max(env_int("IAQ_CCS811_FALLBACK_S", 300), 1));
+
+    // Local readers (dashboards, controllers, loggers) pick up the latest readings from here.
+    SharedReadingsPublisher publisher("/iaq-readings", 1);
+    // Clients that want a push stream subscribe here.
+    SubscriptionServer subscription_server("/tmp/iaq.sock");
+    subscription_server.start();
+
+    // IAQ_ARCHIVE=<file> keeps every sample in a compressed archive. An existing archive is appended
+    // to, pending samples are flushed every IAQ_ARCHIVE_FLUSH_S seconds.
+    std::unique_ptr<ArchiveWriter> archive;
+    if (getenv("IAQ_ARCHIVE") != nullptr) {
+        archive.reset(new ArchiveWriter(getenv("IAQ_ARCHIVE")));
+    }
+
+    // Samples are taken on a 1 s grid aligned to the wall clock. IAQ_RT_PRIORITY, IAQ_CPU and
+    // IAQ_MLOCK make the loop a SCHED_FIFO thread pinned to a CPU with its memory locked.
+    SamplingLoop::Options loop_options;
+    loop_options.realtime_priority = env_int("IAQ_RT_PRIORITY", 0);
+    loop_options.cpu = env_int("IAQ_CPU", -1);
+    loop_options.lock_memory = getenv("IAQ_MLOCK") != nullptr;
+    SamplingLoop loop(loop_options);
+    auto archive_flush_cycles = static_cast<uint64_t>(std::max(env_int("IAQ_ARCHIVE_FLUSH_S", 300), 1));
+
+    // Temperature for the CCS811 environmental compensation, fused from both sensors.
+    TemperatureFusion fusion(1);
+    uint64_t last_sample_ns = 0;
+    // Environment last sent to the CCS811. In threshold mode it is only rewritten when it changed
+    // noticeably, so that a steady room causes no I2C traffic to the CCS811 at all.
+    double env_humidity = NAN, env_temperature = NAN;
+
+    while (!stop_requested) {
+        auto stamp = loop.wait_next();
+
+        // Whether the first sample asserts nINT is not specified, so the CCS811 is also polled once it
+        // has a sample: writing MEAS_MODE restarted sampling, the first result is surely there two
+        // cycles later. Without that a room that stays in one band would never be reported.
+        bool poll_ccs811 = stamp.cycle >= 2 && (stamp.cycle - 2) % ccs811_fallback_cycles == 0;
+        if (ccs811_threshold_mode && !poll_ccs811) {
+            // Only checks the GPIO, the results are read over I2C when nINT is asserted.
+            ccs811.wait_for_threshold(std::chrono::milliseconds(0));
+        } else {
+            ccs811.read_sensors();
+        }
         bmp280.measure();
 
         float t_si7021 = si7021.measure_temperature();
         double t_bmp20 = bmp280.get_temperature();
         float relative_humidity = si7021.measure_humidity();
 
+        double t_si7021_reading = t_si7021;
+        double dt = last_sample_ns ? (stamp.monotonic_ns - last_sample_ns) / 1e9 : 0.0;
+        last_sample_ns = stamp.monotonic_ns;
+        fusion.update(&t_si7021_reading, &t_bmp20, dt);
+        double t_fused = fusion.get_temperature(0);
+
         std::cout << "T(Si7021): " << std::fixed << std::setprecision(2) << t_si7021 << "°C";
         std::cout << "\tT(BMP280): " << std::fixed << std::setprecision(2) << t_bmp20 << "°C";
+        std::cout << "\tT(fused): " << std::fixed << std::setprecision(2) << t_fused << "°C";
         std::cout << "\tRH: " << std::fixed << std::setprecision(2) << relative_humidity << "%";
         std::cout << "\tCO2: " << std::dec << ccs811.get_co2() << "ppm";
         std::cout << "\tTVOC: " << std::dec << ccs811.get_tvoc() << "ppm";
         std::cout << "\tPres: " << std::fixed << std::setprecision(2) << bmp280.get_pressure() << "hPa";
         std::cout << std::endl;
 
-        ccs811.set_env_data(relative_humidity, (t_si7021 + t_bmp20) / 2);
+        BoardReadings readings{};
+        readings.sample_no = stamp.cycle + 1;
+        readings.monotonic_ns = stamp.monotonic_ns;
+        readings.realtime_ns = stamp.realtime_ns;
+        readings.bmp280_temperature = t_bmp20;
+        readings.bmp280_pressure = bmp280.get_pressure();
+        readings.si7021_temperature = t_si7021;
+        readings.si7021_humidity = relative_humidity;
+        readings.ccs811_co2 = ccs811.get_co2();
+        readings.ccs811_tvoc = ccs811.get_tvoc();
+        publisher.publish(0, readings);
+        subscription_server.publish(0, readings);
+
+        if (archive) {
+            archive->append({static_cast<int64_t>(readings.realtime_ns / 1000000), readings.bmp280_temperature,
+                             readings.bmp280_pressure, readings.si7021_temperature, readings.si7021_humidity,
+                             readings.ccs811_co2, readings.ccs811_tvoc});
+            if (stamp.cycle % archive_flush_cycles == archive_flush_cycles - 1) archive->flush();
+        }
 
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        // Failed measurements are NaN. The CCS811 keeps its last environment data until both are valid.
+        bool env_valid = std::isfinite(relative_humidity) && std::isfinite(t_fused);
+        if (env_valid && (!ccs811_threshold_mode || !(std::fabs(relative_humidity - env_humidity) < 1.0) ||
+                          !(std::fabs(t_fused - env_temperature) < 0.5))) {
+            ccs811.set_env_data(relative_humidity, t_fused);
+            env_humidity = relative_humidity;
+            env_temperature = t_fused;
+        }
+
+        auto &stats = loop.get_stats();
+        if (stats.cycles % 3600 == 0) {
+            std::cout << "[SamplingLoop] Cycles: " << stats.cycles << "\tMissed deadlines: " << stats.missed_deadlines
+                      << "\tJitter mean/max: " << stats.mean_jitter_ns() / 1000 << "/" << stats.max_jitter_ns / 1000
+                      << "us" << std::endl;
+        }
+
+        handle_trace_toggle(trace_path);
     }
+
+    std::cout << "Stopping." << std::endl;
+    if (archive) archive->close();
+    subscription_server.stop();
+    return 0;
 }
@@ -0,0 +1,93 @@
+// Compression ratio and decode throughput of the archive on 30 days of synthetic 1 Hz samples.
+// Not run by ctest: build the archive_benchmark target and run it on the machine of interest.
+
+#include "Archive.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Slowly varying indoor conditions with sensor noise at the resolution of the parts.
+static std::vector<ArchiveSample> make_samples(size_t count) {
+    std::mt19937_64 random(1);
+    std::normal_distribution<double> noise(0, 1);
+    std::vector<ArchiveSample> samples;
+    samples.reserve(count);
+    double co2 = 450;
+    for (size_t i = 0; i < count; i++) {
+        double day = 2 * M_PI * static_cast<double>(i) / 86400;
+        double temperature = 21 + 1.5 * std::sin(day);
+        double humidity = 45 - 5 * std::sin(day);
+        co2 = std::max(400.0, co2 + noise(random) * 3 + (i % 86400 < 28800 ? 0.02 : -0.02));
+
+        ArchiveSample sample{};
+        sample.timestamp_ms = 1600000000000LL + static_cast<int64_t>(i) * 1000 + static_cast<int64_t>(random() % 3);
+        sample.bmp280_temperature = temperature + 0.8 + noise(random) * 0.01;
+        sample.bmp280_pressure = 1013 + 4 * std::sin(day / 3) + noise(random) * 0.02;
+        sample.si7021_temperature = static_cast<float>(temperature + noise(random) * 0.01);
+        sample.si7021_humidity = static_cast<float>(humidity + noise(random) * 0.03);
+        sample.ccs811_co2 = static_cast<uint16_t>(co2);
+        sample.ccs811_tvoc = static_cast<uint16_t>((co2 - 400) / 5);
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+// Size of the same samples as printed by the daemon, one line per sample.
+static size_t text_size(const std::vector<ArchiveSample> &samples) {
+    size_t size = 0;
+    char line[256];
+    for (auto &s : samples) {
+        size += static_cast<size_t>(snprintf(line, sizeof(line),
+                                             "%lld\tT(Si7021): %.2f°C\tT(BMP280): %.2f°C\tRH: %.2f%%\tCO2: %uppm"
+                                             "\tTVOC: %uppm\tPres: %.2fhPa\n",
+                                             static_cast<long long>(s.timestamp_ms), s.si7021_temperature,
+                                             s.bmp280_temperature, s.si7021_humidity, s.ccs811_co2, s.ccs811_tvoc,
+                                             s.bmp280_pressure));
+    }
+    return size;
+}
+
+static void run(const char *name, const std::vector<ArchiveSample> &samples, double quantum, size_t text_bytes) {
+    auto path = "/tmp/iaq-archive-benchmark-" + std::to_string(getpid());
+    {
+        ArchiveWriter writer(path, quantum);
+        for (auto &sample : samples) writer.append(sample);
+    }
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    auto archive_bytes = static_cast<size_t>(file.tellg());
+
+    ArchiveReader reader(path);
+    std::vector<ArchiveSample> decoded;
+    decoded.reserve(samples.size());
+    auto start = std::chrono::steady_clock::now();
+    const int rounds = 5;
+    for (int i = 0; i < rounds; i++) {
+        decoded.clear();
+        reader.read_all(decoded);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double samples_per_s = rounds * static_cast<double>(decoded.size()) / elapsed.count();
+    remove(path.c_str());
+
+    printf("%-9s %10zu bytes  %5.2f bytes/sample  %5.1fx smaller than text  decode %6.1f M samples/s"
+           " (%.0f MB/s of ArchiveSample)\n",
+           name, archive_bytes, static_cast<double>(archive_bytes) / samples.size(),
+           static_cast<double>(text_bytes) / archive_bytes, samples_per_s / 1e6,
+           samples_per_s * sizeof(ArchiveSample) / 1e6);
+}
+
+int main() {
+    auto samples = make_samples(30 * 86400);
+    auto text_bytes = text_size(samples);
+    printf("%zu samples, %zu bytes as text\n", samples.size(), text_bytes);
+    run("quantized", samples, 0.01, text_bytes);
+    run("lossless", samples, 0, text_bytes);
+    return 0;
+}
@@ -0,0 +1,372 @@
+// Round trips samples through archives and checks recovery, appending and range queries.
+
+#include "Check.h"
+
+#include "Archive.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static std::string archive_path(const char *name) {
+    return "/tmp/iaq-archive-test-" + std::to_string(getpid()) + "-" + name;
+}
+
+static void copy_file(const std::string &from, const std::string &to, size_t max_bytes = SIZE_MAX) {
+    std::ifstream in(from, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    bytes.resize(std::min(bytes.size(), max_bytes));
+    std::ofstream(to, std::ios::binary).write(bytes.data(), bytes.size());
+}
+
+static size_t file_size(const std::string &path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return static_cast<size_t>(in.tellg());
+}
+
+static bool same_bits(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static bool same_bits(float a, float b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// 1 Hz samples with irregular timestamps and values whose deltas cover every bucket size, so all
+// prefixes of the bucketed encodings and every kind of XOR window are exercised.
+static std::vector<ArchiveSample> make_samples(size_t count, bool lossless) {
+    std::mt19937_64 random(42);
+    std::vector<ArchiveSample> samples;
+    int64_t timestamp = 1600000000000LL;
+    double temperature = 21.0, pressure = 1000.0;
+    int co2 = 400, tvoc = 0;
+    for (size_t i = 0; i < count; i++) {
+        switch (i % 97) {
+            case 13: timestamp += 1; break;
+            case 31: timestamp += 70000; break;
+            case 53: timestamp += 8589934592LL; break;
+            case 71: timestamp += 0; break;
+            default: timestamp += 1000 + static_cast<int64_t>(random() % 5) - 2; break;
+        }
+        switch (i % 89) {
+            case 7: temperature += 1e6; break;
+            case 8: temperature -= 1e6; break;
+            case 20: co2 = 65535; break;
+            case 21: co2 = 0; break;
+            default: break;
+        }
+        temperature += (static_cast<double>(random() % 2001) - 1000) / 1000.0 * (i % 3);
+        pressure += (static_cast<double>(random() % 201) - 100) / 100.0;
+        co2 = std::max(0, std::min(65535, co2 + static_cast<int>(random() % 401) - 200));
+        tvoc = static_cast<int>(random() % 300);
+
+        ArchiveSample sample{timestamp, temperature, pressure, static_cast<float>(temperature - 0.5),
+                             static_cast<float>(40 + (random() % 1000) / 100.0), static_cast<uint16_t>(co2),
+                             static_cast<uint16_t>(tvoc)};
+        if (lossless && i % 50 == 10) {
+            // Arbitrary bit patterns: full width XOR windows and special values.
+            uint64_t bits = random();
+            memcpy(&sample.bmp280_pressure, &bits, sizeof(bits));
+            sample.si7021_humidity = std::numeric_limits<float>::quiet_NaN();
+            sample.bmp280_temperature = -0.0;
+        }
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+static void test_lossless_round_trip() {
+    auto path = archive_path("lossless");
+    auto samples = make_samples(5000, true);
+    {
+        ArchiveWriter writer(path, 0, 256);
+        for (auto &sample : samples) writer.append(sample);
+    }
+
+    ArchiveReader reader(path);
+    CHECK_EQ(reader.get_sample_count(), samples.size());
+    CHECK_EQ(reader.get_block_count(), (samples.size() + 255) / 256);
+    std::vector<ArchiveSample> decoded;
+    reader.read_all(decoded);
+    CHECK_EQ(decoded.size(), samples.size());
+    size_t mismatches = 0;
+    for (size_t i = 0; i < std::min(decoded.size(), samples.size()); i++) {
+        auto &a = decoded[i];
+        auto &b = samples[i];
+        if (a.timestamp_ms != b.timestamp_ms || !same_bits(a.bmp280_temperature, b.bmp280_temperature) ||
+            !same_bits(a.bmp280_pressure, b.bmp280_pressure) ||
+            !same_bits(a.si7021_temperature, b.si7021_temperature) ||
+            !same_bits(a.si7021_humidity, b.si7021_humidity) || a.ccs811_co2 != b.ccs811_co2 ||
+            a.ccs811_tvoc != b.ccs811_tvoc) {
+            mismatches++;
+        }
+    }
+    CHECK_EQ(mismatches, 0u);
+    remove(path.c_str());
+}
+
+static void test_lossy_round_trip() {
+    auto path = archive_path("lossy");
+    auto samples = make_samples(3000, false);
+    {
+        ArchiveWriter writer(path, 0.01, 1024);
+        for (auto &sample : samples) writer.append(sample);
+    }
+
+    ArchiveReader reader(path);
+    std::vector<ArchiveSample> decoded;
+    reader.read_all(decoded);
+    CHECK_EQ(decoded.size(), samples.size());
+    size_t mismatches = 0;
+    for (size_t i = 0; i < std::min(decoded.size(), samples.size()); i++) {
+        auto &a = decoded[i];
+        auto &b = samples[i];
+        // Values are rounded to the quantum, floats additionally to their own precision.
+        if (a.timestamp_ms != b.timestamp_ms || std::fabs(a.bmp280_temperature - b.bmp280_temperature) > 0.005001 ||
+            std::fabs(a.bmp280_pressure - b.bmp280_pressure) > 0.005001 ||
+            std::fabs(a.si7021_temperature - b.si7021_temperature) > 0.0051 ||
+            std::fabs(a.si7021_humidity - b.si7021_humidity) > 0.0051 || a.ccs811_co2 != b.ccs811_co2 ||
+            a.ccs811_tvoc != b.ccs811_tvoc) {
+            mismatches++;
+        }
+    }
+    CHECK_EQ(mismatches, 0u);
+    remove(path.c_str());
+}
+
+// Failed measurements are NaN. Quantized archives store them, and infinities, as NaN without
+// disturbing the neighboring values.
+static void test_lossy_missing_values() {
+    auto path = archive_path("missing");
+    auto samples = make_samples(200, false);
+    for (size_t i = 0; i < samples.size(); i += 7) samples[i].si7021_temperature = NAN;
+    for (size_t i = 3; i < samples.size(); i += 11) samples[i].si7021_humidity = INFINITY;
+    samples[0].bmp280_temperature = NAN;
+    samples[199].bmp280_pressure = -INFINITY;
+    {
+        ArchiveWriter writer(path, 0.01, 64);
+        for (auto &sample : samples) writer.append(sample);
+    }
+
+    ArchiveReader reader(path);
+    std::vector<ArchiveSample> decoded;
+    reader.read_all(decoded);
+    CHECK_EQ(decoded.size(), samples.size());
+    size_t mismatches = 0;
+    auto matches = [](double decoded_value, double value) {
+        return std::isfinite(value) ? std::fabs(decoded_value - value) <= 0.0051 : std::isnan(decoded_value);
+    };
+    for (size_t i = 0; i < std::min(decoded.size(), samples.size()); i++) {
+        auto &a = decoded[i];
+        auto &b = samples[i];
+        if (!matches(a.bmp280_temperature, b.bmp280_temperature) || !matches(a.bmp280_pressure, b.bmp280_pressure) ||
+            !matches(a.si7021_temperature, b.si7021_temperature) ||
+            !matches(a.si7021_humidity, b.si7021_humidity)) {
+            mismatches++;
+        }
+    }
+    CHECK_EQ(mismatches, 0u);
+    remove(path.c_str());
+}
+
+static std::vector<ArchiveSample> regular_samples(int64_t first_ms, size_t count) {
+    std::vector<ArchiveSample> samples;
+    for (size_t i = 0; i < count; i++) {
+        samples.push_back({first_ms + static_cast<int64_t>(i) * 1000, 20.0 + i * 0.01, 1000.0, 20.5f, 45.0f,
+                           static_cast<uint16_t>(400 + i % 100), 10});
+    }
+    return samples;
+}
+
+static std::vector<int64_t> range_timestamps(ArchiveReader &reader, int64_t from_ms, int64_t to_ms) {
+    std::vector<ArchiveSample> samples;
+    reader.read_range(from_ms, to_ms, samples);
+    std::vector<int64_t> timestamps;
+    for (auto &sample : samples) timestamps.push_back(sample.timestamp_ms);
+    return timestamps;
+}
+
+static void test_read_range() {
+    auto path = archive_path("range");
+    // Blocks of 10 samples: block b covers 1000 * [10b, 10b + 9] ms.
+    {
+        ArchiveWriter writer(path, 0.01, 10);
+        for (auto &sample : regular_samples(0, 95)) writer.append(sample);
+    }
+    ArchiveReader reader(path);
+    CHECK_EQ(reader.get_block_count(), 10u);
+
+    CHECK(range_timestamps(reader, -5000, 0).empty());
+    CHECK(range_timestamps(reader, 95000, 200000).empty());
+    CHECK(range_timestamps(reader, 12000, 12000).empty());
+    CHECK(range_timestamps(reader, 12500, 13000).empty());
+
+    // from is inclusive, to is exclusive.
+    auto timestamps = range_timestamps(reader, 9000, 10000);
+    CHECK_EQ(timestamps.size(), 1u);
+    if (timestamps.size() == 1) CHECK_EQ(timestamps[0], 9000);
+
+    // Exactly one block, starting and ending on block boundaries.
+    timestamps = range_timestamps(reader, 10000, 20000);
+    CHECK_EQ(timestamps.size(), 10u);
+    if (!timestamps.empty()) {
+        CHECK_EQ(timestamps.front(), 10000);
+        CHECK_EQ(timestamps.back(), 19000);
+    }
+
+    // Spanning several blocks with partial blocks at both ends.
+    timestamps = range_timestamps(reader, 18500, 41001);
+    CHECK_EQ(timestamps.size(), 23u);
+    if (!timestamps.empty()) {
+        CHECK_EQ(timestamps.front(), 19000);
+        CHECK_EQ(timestamps.back(), 41000);
+    }
+
+    // The short last block.
+    timestamps = range_timestamps(reader, 90000, 1000000);
+    CHECK_EQ(timestamps.size(), 5u);
+
+    CHECK_EQ(range_timestamps(reader, INT64_MIN, INT64_MAX).size(), 95u);
+    remove(path.c_str());
+}
+
+static void test_unclosed_and_truncated() {
+    auto path = archive_path("unclosed");
+    auto copy = archive_path("unclosed-copy");
+    auto truncated = archive_path("truncated");
+    auto samples = regular_samples(1000000, 35);
+    {
+        ArchiveWriter writer(path, 0.01, 10);
+        for (auto &sample : samples) writer.append(sample);
+        // Three complete blocks are on disk, the index and the last 5 samples aren't.
+        copy_file(path, copy);
+        // Cut into the middle of the third block.
+        copy_file(path, truncated, file_size(path) - 7);
+    }
+
+    ArchiveReader reader(copy);
+    CHECK_EQ(reader.get_block_count(), 3u);
+    CHECK_EQ(reader.get_sample_count(), 30u);
+    CHECK_EQ(range_timestamps(reader, 1012000, 1015000).size(), 3u);
+
+    ArchiveReader truncated_reader(truncated);
+    CHECK_EQ(truncated_reader.get_block_count(), 2u);
+    std::vector<ArchiveSample> decoded;
+    truncated_reader.read_all(decoded);
+    CHECK_EQ(decoded.size(), 20u);
+    if (decoded.size() == 20) CHECK_EQ(decoded.back().timestamp_ms, samples[19].timestamp_ms);
+
+    // Reopening an unclosed, truncated archive drops the incomplete block and carries on after it.
+    {
+        ArchiveWriter writer(truncated, 0.5, 100);
+        for (size_t i = 20; i < samples.size(); i++) writer.append(samples[i]);
+    }
+    ArchiveReader reopened(truncated);
+    CHECK_EQ(reopened.get_sample_count(), 35u);
+    decoded.clear();
+    reopened.read_all(decoded);
+    CHECK_EQ(decoded.size(), 35u);
+    // The archive keeps its own quantum and block size.
+    CHECK_EQ(reopened.get_block_count(), 4u);
+    if (decoded.size() == 35) CHECK_NEAR(decoded[34].bmp280_temperature, samples[34].bmp280_temperature, 0.005001);
+
+    remove(path.c_str());
+    remove(copy.c_str());
+    remove(truncated.c_str());
+}
+
+static void test_append_and_flush() {
+    auto path = archive_path("append");
+    auto samples = regular_samples(0, 50);
+    {
+        ArchiveWriter writer(path, 0.01, 20);
+        for (size_t i = 0; i < 25; i++) writer.append(samples[i]);
+    }
+    {
+        // A restart appends to the archive instead of replacing it.
+        ArchiveWriter writer(path);
+        for (size_t i = 25; i < 37; i++) writer.append(samples[i]);
+
+        // flush() makes pending samples durable without closing.
+        writer.flush();
+        auto copy = archive_path("append-copy");
+        copy_file(path, copy);
+        ArchiveReader partial(copy);
+        CHECK_EQ(partial.get_sample_count(), 37u);
+        remove(copy.c_str());
+
+        for (size_t i = 37; i < samples.size(); i++) writer.append(samples[i]);
+    }
+
+    ArchiveReader reader(path);
+    std::vector<ArchiveSample> decoded;
+    reader.read_all(decoded);
+    CHECK_EQ(decoded.size(), samples.size());
+    for (size_t i = 0; i < std::min(decoded.size(), samples.size()); i++) {
+        CHECK_EQ(decoded[i].timestamp_ms, samples[i].timestamp_ms);
+    }
+    CHECK_EQ(range_timestamps(reader, 24000, 27000).size(), 3u);
+    remove(path.c_str());
+}
+
+// A wall clock that steps back must not produce blocks out of time order.
+static void test_timestamps_going_backwards() {
+    auto path = archive_path("backwards");
+    {
+        ArchiveWriter writer(path, 0.01, 4);
+        for (auto &sample : regular_samples(100000, 6)) writer.append(sample);
+        for (auto &sample : regular_samples(102500, 6)) writer.append(sample);
+    }
+    {
+        // Also across a restart.
+        ArchiveWriter writer(path);
+        for (auto &sample : regular_samples(50000, 2)) writer.append(sample);
+    }
+
+    ArchiveReader reader(path);
+    std::vector<ArchiveSample> decoded;
+    reader.read_all(decoded);
+    CHECK_EQ(decoded.size(), 14u);
+    const int64_t expected[] = {100000, 101000, 102000, 103000, 104000, 105000,
+                                105000, 105000, 105000, 105500, 106500, 107500, 107500, 107500};
+    for (size_t i = 0; i < std::min<size_t>(decoded.size(), 14); i++) {
+        CHECK_EQ(decoded[i].timestamp_ms, expected[i]);
+    }
+    CHECK_EQ(range_timestamps(reader, 105000, 105001).size(), 4u);
+    CHECK_EQ(range_timestamps(reader, 105500, 108000).size(), 5u);
+    remove(path.c_str());
+}
+
+static void test_not_an_archive() {
+    auto path = archive_path("text");
+    std::ofstream(path) << "not an archive\n";
+    bool threw = false;
+    try {
+        ArchiveWriter writer(path);
+    } catch (int) {
+        threw = true;
+    }
+    CHECK(threw);
+    // The file is left alone.
+    CHECK_EQ(file_size(path), 15u);
+    remove(path.c_str());
+}
+
+int main() {
+    test_lossless_round_trip();
+    test_lossy_round_trip();
+    test_lossy_missing_values();
+    test_read_range();
+    test_unclosed_and_truncated();
+    test_append_and_flush();
+    test_timestamps_going_backwards();
+    test_not_an_archive();
+    return check_failures();
+}
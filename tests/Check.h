@@ -0,0 +1,44 @@
+#ifndef IAQ_CHECK_H
+#define IAQ_CHECK_H
+
+#include <cmath>
+#include <iostream>
+
+// Minimal assertions for the test executables. A failed check is reported and the test carries
+// on, main() returns check_failures() so ctest sees a non-zero exit status.
+inline int &check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            check_failures()++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        auto check_actual = (actual); \
+        auto check_expected = (expected); \
+        if (!(check_actual == check_expected)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #actual ", " #expected ") failed: " \
+                      << check_actual << " != " << check_expected << std::endl; \
+            check_failures()++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        double check_actual = (actual); \
+        double check_expected = (expected); \
+        if (!(std::fabs(check_actual - check_expected) <= (tolerance))) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" #actual ", " #expected ") failed: " \
+                      << check_actual << " vs " << check_expected << std::endl; \
+            check_failures()++; \
+        } \
+    } while (0)
+
+#endif //IAQ_CHECK_H
@@ -0,0 +1,393 @@
+// Runs the sensor drivers against the emulated parts on a virtual clock.
+
+#include "Check.h"
+
+#include "BMP280.h"
+#include "BMP280Emulator.h"
+#include "CCS811.h"
+#include "CCS811Emulator.h"
+#include "SI7021.h"
+#include "SI7021Emulator.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+static bool write_bytes(EmulatedDevice &device, std::initializer_list<uint8_t> bytes) {
+    uint8_t buffer[8];
+    std::copy(bytes.begin(), bytes.end(), buffer);
+    return device.write(buffer, bytes.size()) == static_cast<ssize_t>(bytes.size());
+}
+
+static uint8_t read_register(EmulatedDevice &device, uint8_t reg) {
+    uint8_t value = 0;
+    write_bytes(device, {reg});
+    device.read(&value, 1);
+    return value;
+}
+
+// RES1:RES0 index into the emulator tables for a driver resolution.
+static uint8_t resolution_index(SI7021::Resolution resolution) {
+    return static_cast<uint8_t>(((resolution >> 6) & 2) | (resolution & 1));
+}
+
+static void test_si7021_serial_and_crc() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<SI7021Emulator>(clock);
+
+    // Check value of the CRC-8 used by the part (poly 0x31, init 0x00) over "123456789".
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    CHECK_EQ(static_cast<int>(SI7021Emulator::crc8(check, sizeof(check))), 0xA2);
+
+    SI7021 si7021(emulator);
+    CHECK_EQ(si7021.get_serial(), 0x1122334415ffb5ffULL);
+    CHECK_EQ(static_cast<int>(si7021.get_fw_rev()), 0x20);
+
+    // The first serial number half carries a running checksum after every byte.
+    uint8_t sna[8];
+    CHECK(write_bytes(*emulator, {0xFA, 0x0F}));
+    CHECK_EQ(emulator->read(sna, sizeof(sna)), 8);
+    uint8_t crc = 0;
+    for (int i = 0; i < 4; i++) {
+        crc = SI7021Emulator::crc8(&sna[2 * i], 1, crc);
+        CHECK_EQ(static_cast<int>(sna[2 * i + 1]), static_cast<int>(crc));
+    }
+}
+
+static void test_si7021_nack_while_converting() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<SI7021Emulator>(clock);
+    emulator->set_temperature(22.0);
+
+    // "No hold master": the address is NACKed until the conversion is done.
+    CHECK(write_bytes(*emulator, {0xF3}));
+    uint8_t data[3];
+    CHECK_EQ(emulator->read(data, 3), -1);
+    CHECK(!write_bytes(*emulator, {0xE7}));
+
+    emulator->sleep(SI7021Emulator::temperature_conversion_time(0));
+    CHECK_EQ(emulator->read(data, 3), 3);
+    CHECK_EQ(static_cast<int>(data[2]), static_cast<int>(SI7021Emulator::crc8(data, 2)));
+
+    // "Hold master": the clock is stretched until the result is available.
+    auto start = clock->now();
+    CHECK(write_bytes(*emulator, {0xE3}));
+    CHECK_EQ(emulator->read(data, 3), 3);
+    CHECK(clock->now() - start >= SI7021Emulator::temperature_conversion_time(0));
+}
+
+// The conversion time follows RES1:RES0 in the user register, the address is NACKed until then.
+static void test_si7021_resolution_timing() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<SI7021Emulator>(clock);
+
+    for (uint8_t index = 0; index < 4; index++) {
+        auto user_register = static_cast<uint8_t>((emulator->get_user_register() & 0x7E) | ((index & 2) << 6) |
+                                                  (index & 1));
+        CHECK(write_bytes(*emulator, {0xE6, user_register}));
+        CHECK_EQ(static_cast<int>(read_register(*emulator, 0xE7)), static_cast<int>(user_register));
+
+        uint8_t data[3];
+        CHECK(write_bytes(*emulator, {0xF3}));
+        emulator->sleep(SI7021Emulator::temperature_conversion_time(index) - microseconds(500));
+        CHECK_EQ(emulator->read(data, 3), -1);
+        emulator->sleep(microseconds(1000));
+        CHECK_EQ(emulator->read(data, 3), 3);
+
+        CHECK(write_bytes(*emulator, {0xF5}));
+        emulator->sleep(SI7021Emulator::humidity_conversion_time(index) - microseconds(500));
+        CHECK_EQ(emulator->read(data, 3), -1);
+        emulator->sleep(microseconds(1000));
+        CHECK_EQ(emulator->read(data, 3), 3);
+    }
+}
+
+// The driver programs the resolution, waits exactly its conversion time and drives the heater.
+static void test_si7021_resolution_and_heater() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<SI7021Emulator>(clock);
+    emulator->set_temperature(23.4);
+    emulator->set_humidity(41.0);
+    SI7021 si7021(emulator);
+
+    const SI7021::Resolution resolutions[] = {SI7021::RH_12_BIT_TEMP_14_BIT, SI7021::RH_8_BIT_TEMP_12_BIT,
+                                              SI7021::RH_10_BIT_TEMP_13_BIT, SI7021::RH_11_BIT_TEMP_11_BIT};
+    for (auto resolution : resolutions) {
+        si7021.set_resolution(resolution);
+        CHECK_EQ(static_cast<int>(emulator->get_user_register() & 0x81), static_cast<int>(resolution));
+
+        auto index = resolution_index(resolution);
+        CHECK(SI7021::conversion_time(resolution, false) == SI7021Emulator::temperature_conversion_time(index));
+        CHECK(SI7021::conversion_time(resolution, true) == SI7021Emulator::humidity_conversion_time(index));
+
+        // The driver waits exactly the conversion time, plus a few bytes on the bus.
+        auto start = clock->now();
+        CHECK_NEAR(si7021.measure_temperature(), 23.4, 0.2);
+        auto elapsed = clock->now() - start;
+        CHECK(elapsed >= SI7021::conversion_time(resolution, false));
+        CHECK(elapsed < SI7021::conversion_time(resolution, false) + milliseconds(1));
+
+        start = clock->now();
+        CHECK_NEAR(si7021.measure_humidity(), 41.0, 0.6);
+        elapsed = clock->now() - start;
+        CHECK(elapsed >= SI7021::conversion_time(resolution, true));
+        CHECK(elapsed < SI7021::conversion_time(resolution, true) + milliseconds(1));
+    }
+
+    si7021.set_heater(true, 5);
+    CHECK(si7021.is_heater_enabled());
+    CHECK_EQ(static_cast<int>(emulator->get_heater_register()), 5);
+    CHECK((emulator->get_user_register() & 0x04) != 0);
+    si7021.set_heater(false);
+    CHECK(!si7021.is_heater_enabled());
+    CHECK((emulator->get_user_register() & 0x04) == 0);
+}
+
+// Si7021 that stops answering reads, e.g. a loose connection.
+class FailingSI7021Emulator : public SI7021Emulator {
+public:
+    using SI7021Emulator::SI7021Emulator;
+
+    bool fail_reads = false;
+
+protected:
+    bool on_read(uint8_t *buffer, size_t buffer_len) override {
+        return !fail_reads && SI7021Emulator::on_read(buffer, buffer_len);
+    }
+};
+
+static void test_si7021_failed_read() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<FailingSI7021Emulator>(clock);
+    SI7021 si7021(emulator);
+    CHECK(!std::isnan(si7021.measure_temperature()));
+
+    // A missing result is NaN, not a plausible 0 °C or 0 %RH.
+    emulator->fail_reads = true;
+    CHECK(std::isnan(si7021.measure_temperature()));
+    CHECK(std::isnan(si7021.measure_humidity()));
+}
+
+static void test_bmp280_measuring() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<BMP280Emulator>(clock);
+
+    CHECK((read_register(*emulator, BMP280Emulator::STATUS) & BMP280Emulator::STATUS_IM_UPDATE) != 0);
+    emulator->sleep(milliseconds(3));
+    CHECK_EQ(static_cast<int>(read_register(*emulator, BMP280Emulator::STATUS)), 0);
+
+    // Forced mode, x1 oversampling: measuring until the conversion is done, then back to sleep.
+    CHECK(write_bytes(*emulator, {BMP280Emulator::CTRL_MEAS, (1 << 5) | (1 << 2) | 1}));
+    CHECK((read_register(*emulator, BMP280Emulator::STATUS) & BMP280Emulator::STATUS_MEASURING) != 0);
+    CHECK_EQ(emulator->get_conversion_count(), 0u);
+
+    emulator->sleep(BMP280Emulator::conversion_time(1, 1));
+    CHECK_EQ(static_cast<int>(read_register(*emulator, BMP280Emulator::STATUS)), 0);
+    CHECK_EQ(static_cast<int>(read_register(*emulator, BMP280Emulator::CTRL_MEAS) & 3), 0);
+    CHECK_EQ(emulator->get_conversion_count(), 1u);
+}
+
+static void test_bmp280_compensation() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<BMP280Emulator>(clock);
+    emulator->set_temperature(21.5);
+    emulator->set_pressure(1002.3);
+
+    // The driver runs the part in normal mode with a 500 ms standby time.
+    BMP280 bmp280(emulator);
+    emulator->sleep(std::chrono::seconds(1));
+    bmp280.measure();
+    CHECK_NEAR(bmp280.get_temperature(), 21.5, 0.01);
+    CHECK_NEAR(bmp280.get_pressure(), 1002.3, 0.05);
+    CHECK_EQ(emulator->get_conversion_count(), 2u);
+
+    emulator->set_temperature(-5.25);
+    emulator->set_pressure(950.0);
+    emulator->sleep(milliseconds(600));
+    bmp280.measure();
+    CHECK_NEAR(bmp280.get_temperature(), -5.25, 0.01);
+    CHECK_NEAR(bmp280.get_pressure(), 950.0, 0.05);
+}
+
+static void test_ccs811_modes() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<CCS811Emulator>(clock);
+
+    // Boot mode: the algorithm registers don't exist yet.
+    CHECK(!emulator->in_app_mode());
+    auto status = read_register(*emulator, CCS811Emulator::STATUS);
+    CHECK((status & CCS811Emulator::STATUS_FW_MODE) == 0);
+    CHECK((status & CCS811Emulator::STATUS_APP_VALID) != 0);
+    read_register(*emulator, CCS811Emulator::ALG_RESULT_DATA);
+    CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_ERROR) != 0);
+
+    // Selecting and reading the register both fail. ERROR_ID is cleared by reading it.
+    CHECK_EQ(static_cast<int>(read_register(*emulator, CCS811Emulator::ERROR_ID)),
+             CCS811Emulator::WRITE_REG_INVALID | CCS811Emulator::READ_REG_INVALID);
+    CHECK_EQ(static_cast<int>(read_register(*emulator, CCS811Emulator::ERROR_ID)), 0);
+    CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_ERROR) == 0);
+
+    CCS811 ccs811(emulator);
+    CHECK(emulator->in_app_mode());
+    CHECK_EQ(static_cast<int>(emulator->get_meas_mode()), 0x10);
+    CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_FW_MODE) != 0);
+
+    emulator->inject_error(CCS811Emulator::HEATER_FAULT);
+    CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_ERROR) != 0);
+    CHECK_EQ(static_cast<int>(read_register(*emulator, CCS811Emulator::ERROR_ID)),
+             static_cast<int>(CCS811Emulator::HEATER_FAULT));
+    CHECK_EQ(static_cast<int>(read_register(*emulator, CCS811Emulator::ERROR_ID)), 0);
+
+    emulator->set_air_quality(812, 97);
+    emulator->sleep(std::chrono::seconds(1));
+    ccs811.read_sensors();
+    CHECK_EQ(ccs811.get_co2(), 812);
+    CHECK_EQ(ccs811.get_tvoc(), 97);
+
+    ccs811.set_env_data(48.5, 22.0);
+    const uint8_t expected_env[] = {0x61, 0x00, 0x5E, 0x00};
+    CHECK(memcmp(emulator->get_env_data(), expected_env, sizeof(expected_env)) == 0);
+}
+
+static void test_ccs811_data_ready() {
+    for (uint8_t drive_mode = 1; drive_mode <= 4; drive_mode++) {
+        auto clock = std::make_shared<EmulatorClock>();
+        auto emulator = std::make_shared<CCS811Emulator>(clock);
+        CHECK(write_bytes(*emulator, {CCS811Emulator::APP_START}));
+        emulator->sleep(milliseconds(1));
+        emulator->set_air_quality(650, 40);
+
+        CHECK(write_bytes(*emulator, {CCS811Emulator::MEAS_MODE, static_cast<uint8_t>(drive_mode << 4)}));
+        auto period = CCS811Emulator::sample_period(drive_mode);
+        emulator->sleep(period - milliseconds(1));
+        CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_DATA_READY) == 0);
+
+        emulator->sleep(milliseconds(1));
+        CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_DATA_READY) != 0);
+        CHECK_EQ(emulator->get_sample_count(), 1u);
+
+        // Mode 4 only produces raw data, the algorithm keeps its reset value of 400 ppm.
+        uint8_t result[8];
+        CHECK(write_bytes(*emulator, {CCS811Emulator::ALG_RESULT_DATA}));
+        CHECK_EQ(emulator->read(result, sizeof(result)), 8);
+        CHECK_EQ((result[0] << 8) | result[1], drive_mode == 4 ? 400 : 650);
+        CHECK((result[4] & CCS811Emulator::STATUS_DATA_READY) != 0);
+        CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_DATA_READY) == 0);
+    }
+
+    // Idle mode never produces samples.
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<CCS811Emulator>(clock);
+    CHECK(write_bytes(*emulator, {CCS811Emulator::APP_START}));
+    emulator->sleep(milliseconds(1));
+    CHECK(write_bytes(*emulator, {CCS811Emulator::MEAS_MODE, 0x00}));
+    emulator->sleep(std::chrono::seconds(120));
+    CHECK((read_register(*emulator, CCS811Emulator::STATUS) & CCS811Emulator::STATUS_DATA_READY) == 0);
+    CHECK_EQ(emulator->get_sample_count(), 0u);
+}
+
+// Ten minutes of flat eCO2 at one sample per second: polling reads STATUS and ALG_RESULT_DATA every
+// second, interrupt-on-threshold only touches the bus when eCO2 changes band.
+static void test_ccs811_threshold_traffic() {
+    const int seconds = 600;
+
+    auto polled_clock = std::make_shared<EmulatorClock>();
+    auto polled = std::make_shared<CCS811Emulator>(polled_clock);
+    polled->set_air_quality(900, 50);
+    CCS811 polling_driver(polled);
+    auto polled_start = polled->get_bus_bytes();
+    for (int i = 0; i < seconds; i++) {
+        polled->sleep(std::chrono::seconds(1));
+        polling_driver.read_sensors();
+    }
+    auto polling_bytes = polled->get_bus_bytes() - polled_start;
+    CHECK_EQ(polling_driver.get_co2(), 900);
+
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<CCS811Emulator>(clock);
+    emulator->set_air_quality(900, 50);
+    CCS811 ccs811(emulator);
+    ccs811.enable_threshold_interrupt(std::make_shared<EmulatedAlertSource>(clock, emulator), 1500, 2500);
+    auto start = emulator->get_bus_bytes();
+    int interrupts = 0;
+    for (int i = 0; i < seconds; i++) {
+        if (ccs811.wait_for_threshold(milliseconds(1000))) interrupts++;
+    }
+    auto threshold_bytes = emulator->get_bus_bytes() - start;
+
+    // Only the first sample after enabling asserts nINT, it establishes the band.
+    CHECK_EQ(interrupts, 1);
+    CHECK_EQ(ccs811.get_co2(), 900);
+    CHECK(polling_bytes >= 8000);
+    CHECK(threshold_bytes <= 32);
+    std::cout << "CCS811 bus bytes over " << seconds << " s: polling " << polling_bytes << ", threshold "
+              << threshold_bytes << std::endl;
+
+    // Moving into another band asserts nINT and updates the results. Changes within a band, or
+    // across a threshold by less than the hysteresis, don't.
+    emulator->set_air_quality(1520, 80);
+    CHECK(ccs811.wait_for_threshold(milliseconds(2000)));
+    CHECK_EQ(ccs811.get_co2(), 1520);
+    emulator->set_air_quality(1820, 90);
+    CHECK(!ccs811.wait_for_threshold(milliseconds(5000)));
+    emulator->set_air_quality(1480, 90);
+    CHECK(!ccs811.wait_for_threshold(milliseconds(5000)));
+    CHECK_EQ(ccs811.get_co2(), 1520);
+    emulator->set_air_quality(2600, 120);
+    CHECK(ccs811.wait_for_threshold(milliseconds(2000)));
+    CHECK_EQ(ccs811.get_co2(), 2600);
+
+    ccs811.disable_threshold_interrupt();
+    CHECK_EQ(static_cast<int>(emulator->get_meas_mode()), 0x10);
+}
+
+// A part whose first sample doesn't assert nINT reports nothing while the room stays in one band,
+// so the host has to read the results once after enabling the interrupt and fall back to polling.
+static void test_ccs811_threshold_without_first_interrupt() {
+    auto clock = std::make_shared<EmulatorClock>();
+    auto emulator = std::make_shared<CCS811Emulator>(clock);
+    emulator->set_first_threshold_interrupt(false);
+    emulator->set_air_quality(1800, 90);
+    CCS811 ccs811(emulator);
+    emulator->sleep(milliseconds(1500));
+
+    // Enabling the interrupt restarts sampling, so a read right away finds no results yet.
+    ccs811.enable_threshold_interrupt(std::make_shared<EmulatedAlertSource>(clock, emulator), 1500, 2500);
+    ccs811.read_sensors();
+    CHECK_EQ(ccs811.get_co2(), 0);
+    CHECK(!ccs811.wait_for_threshold(milliseconds(2000)));
+    ccs811.read_sensors();
+    CHECK_EQ(ccs811.get_co2(), 1800);
+    CHECK(!ccs811.wait_for_threshold(milliseconds(10000)));
+    CHECK(!emulator->interrupt_asserted());
+
+    // Changes within the band are only seen by the fallback poll.
+    emulator->set_air_quality(2000, 100);
+    CHECK(!ccs811.wait_for_threshold(milliseconds(10000)));
+    CHECK_EQ(ccs811.get_co2(), 1800);
+    ccs811.read_sensors();
+    CHECK_EQ(ccs811.get_co2(), 2000);
+
+    emulator->set_air_quality(2600, 120);
+    CHECK(ccs811.wait_for_threshold(milliseconds(2000)));
+    CHECK_EQ(ccs811.get_co2(), 2600);
+}
+
+int main() {
+    test_si7021_serial_and_crc();
+    test_si7021_nack_while_converting();
+    test_si7021_resolution_timing();
+    test_si7021_resolution_and_heater();
+    test_si7021_failed_read();
+    test_bmp280_measuring();
+    test_bmp280_compensation();
+    test_ccs811_modes();
+    test_ccs811_data_ready();
+    test_ccs811_threshold_traffic();
+    test_ccs811_threshold_without_first_interrupt();
+    return check_failures();
+}
@@ -0,0 +1,128 @@
+// Drives the sampling loop with a fake clock to check deadline and wall-clock grid handling.
+
+#include "Check.h"
+
+#include "SamplingLoop.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+
+namespace {
+
+const int64_t MS = 1000000;
+const int64_t SECOND = 1000 * MS;
+
+// Sleeping jumps to the deadline plus a fixed wake up latency. The wall clock runs alongside the
+// monotonic one at an offset that tests can step.
+class FakeClock : public SamplingLoop::Clock {
+public:
+    int64_t monotonic = 5 * SECOND + 300 * MS;
+    int64_t realtime_offset = 1700000000 * SECOND;
+    int64_t wake_latency = 0;
+
+    int64_t monotonic_ns() override { return monotonic; }
+
+    int64_t realtime_ns() override { return monotonic + realtime_offset; }
+
+    void sleep_until(int64_t deadline_ns) override {
+        if (deadline_ns > monotonic) monotonic = deadline_ns;
+        monotonic += wake_latency;
+    }
+};
+
+// Distance of a wall-clock time from the nearest grid point.
+int64_t phase(uint64_t realtime_ns, int64_t period_ns) {
+    auto p = static_cast<int64_t>(realtime_ns % static_cast<uint64_t>(period_ns));
+    return p > period_ns / 2 ? p - period_ns : p;
+}
+
+}
+
+static void test_start_on_grid() {
+    auto clock = std::make_shared<FakeClock>();
+    SamplingLoop loop(SamplingLoop::Options(), clock);
+
+    auto stamp = loop.wait_next();
+    CHECK_EQ(stamp.cycle, 0u);
+    CHECK_EQ(phase(stamp.realtime_ns, SECOND), 0);
+    CHECK_EQ(stamp.monotonic_ns, static_cast<uint64_t>(6 * SECOND));
+    stamp = loop.wait_next();
+    CHECK_EQ(stamp.monotonic_ns, static_cast<uint64_t>(7 * SECOND));
+    CHECK_EQ(loop.get_stats().missed_deadlines, 0u);
+}
+
+// Work that runs 3.5 periods over skips the three deadlines that passed meanwhile and continues
+// on the grid.
+static void test_overrun() {
+    auto clock = std::make_shared<FakeClock>();
+    SamplingLoop loop(SamplingLoop::Options(), clock);
+
+    auto start = loop.wait_next();
+    clock->monotonic += 3 * SECOND + 500 * MS;
+    auto stamp = loop.wait_next();
+    CHECK_EQ(loop.get_stats().missed_deadlines, 3u);
+    CHECK_EQ(stamp.monotonic_ns - start.monotonic_ns, static_cast<uint64_t>(4 * SECOND));
+    CHECK_EQ(phase(stamp.realtime_ns, SECOND), 0);
+    CHECK_EQ(stamp.cycle, 1u);
+
+    // Overrunning by less than a period isn't a miss.
+    clock->monotonic += 900 * MS;
+    loop.wait_next();
+    CHECK_EQ(loop.get_stats().missed_deadlines, 3u);
+}
+
+// A wall-clock step of less than a quarter period shows up in the wake up right after it and is
+// corrected from the one after that on, in either direction.
+static void test_small_step_corrected() {
+    for (int64_t step : {200 * MS, -200 * MS, 5 * MS}) {
+        auto clock = std::make_shared<FakeClock>();
+        SamplingLoop loop(SamplingLoop::Options(), clock);
+        loop.wait_next();
+
+        clock->realtime_offset += step;
+        auto stepped = loop.wait_next();
+        CHECK_EQ(phase(stepped.realtime_ns, SECOND), step);
+        auto corrected = loop.wait_next();
+        CHECK_EQ(phase(corrected.realtime_ns, SECOND), 0);
+        CHECK_EQ(corrected.monotonic_ns - stepped.monotonic_ns, static_cast<uint64_t>(SECOND - step));
+        CHECK_EQ(loop.get_stats().realignments, 1u);
+        CHECK_EQ(loop.get_stats().missed_deadlines, 0u);
+    }
+}
+
+// Wake up latency doesn't count as phase error, and a wall clock that creeps away from the
+// monotonic one is pulled back whenever it leaves phase_tolerance, not on every cycle.
+static void test_stays_within_tolerance() {
+    SamplingLoop::Options options;
+    options.period = std::chrono::milliseconds(100);
+    options.phase_tolerance = std::chrono::milliseconds(2);
+    const int64_t period = 100 * MS;
+    const int64_t tolerance = 2 * MS;
+    const int64_t creep = 100000;
+
+    auto clock = std::make_shared<FakeClock>();
+    clock->wake_latency = 300000;
+    SamplingLoop loop(options, clock);
+
+    const int cycles = 1000;
+    int64_t worst = 0;
+    for (int i = 0; i < cycles; i++) {
+        auto stamp = loop.wait_next();
+        worst = std::max(worst, std::abs(phase(stamp.realtime_ns, period) - clock->wake_latency));
+        clock->realtime_offset += creep;
+    }
+    CHECK(worst <= tolerance + creep);
+    CHECK(loop.get_stats().realignments > 0);
+    CHECK(loop.get_stats().realignments <= static_cast<uint64_t>(cycles * creep / tolerance));
+    CHECK_EQ(loop.get_stats().missed_deadlines, 0u);
+    CHECK_EQ(loop.get_stats().max_jitter_ns, clock->wake_latency);
+}
+
+int main() {
+    test_start_on_grid();
+    test_overrun();
+    test_small_step_corrected();
+    test_stays_within_tolerance();
+    return check_failures();
+}
@@ -0,0 +1,73 @@
+// Publishes readings through a private shared memory segment and reads them back.
+
+#include "Check.h"
+
+#include "SharedReadings.h"
+
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static std::string segment_name() {
+    return "/iaq-readings-test-" + std::to_string(getpid());
+}
+
+static void test_round_trip() {
+    auto name = segment_name();
+    SharedReadingsPublisher publisher(name, 2);
+    SharedReadingsReader reader(name);
+    CHECK_EQ(reader.get_board_count(), 2u);
+
+    BoardReadings readings{};
+    CHECK(!reader.read(0, readings));
+    CHECK(!reader.read(2, readings));
+
+    BoardReadings published{};
+    published.sample_no = 42;
+    published.monotonic_ns = 123456789;
+    published.bmp280_temperature = 21.5;
+    published.ccs811_co2 = 800;
+    publisher.publish(1, published);
+
+    CHECK(!reader.read(0, readings));
+    CHECK(reader.read(1, readings));
+    CHECK_EQ(readings.sample_no, 42u);
+    CHECK_EQ(readings.monotonic_ns, 123456789u);
+    CHECK_EQ(readings.bmp280_temperature, 21.5);
+    CHECK_EQ(readings.ccs811_co2, 800);
+}
+
+// A publisher that dies in the middle of publish() leaves the sequence odd. Readers must give up
+// instead of spinning forever.
+static void test_abandoned_update() {
+    auto name = segment_name();
+    SharedReadingsPublisher publisher(name, 1);
+    BoardReadings published{};
+    published.sample_no = 1;
+    publisher.publish(0, published);
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    CHECK(fd >= 0);
+    void *mem = mmap(nullptr, sizeof(SharedReadingsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    CHECK(mem != MAP_FAILED);
+    if (fd < 0 || mem == MAP_FAILED) return;
+    auto segment = static_cast<SharedReadingsSegment *>(mem);
+    segment->slots[0].sequence.fetch_add(1);
+
+    SharedReadingsReader reader(name);
+    BoardReadings readings{};
+    CHECK(!reader.read(0, readings));
+
+    segment->slots[0].sequence.fetch_add(1);
+    CHECK(reader.read(0, readings));
+    CHECK_EQ(readings.sample_no, 1u);
+    munmap(mem, sizeof(SharedReadingsSegment));
+}
+
+int main() {
+    test_round_trip();
+    test_abandoned_update();
+    return check_failures();
+}
@@ -0,0 +1,360 @@
+// Subscribes to a server on a private socket and checks the frames it sends.
+
+#include "Check.h"
+
+#include "SubscriptionServer.h"
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+static int connect_to(const std::string &path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Publishes until the subscription is active and the first line arrives, or gives up after ~2 s.
+static std::string first_line(SubscriptionServer &server, int fd, const BoardReadings &readings) {
+    std::string line;
+    for (int attempt = 0; attempt < 200 && line.find('\n') == std::string::npos; attempt++) {
+        server.publish(0, readings);
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 10) <= 0) continue;
+        char buffer[512];
+        auto len = read(fd, buffer, sizeof(buffer));
+        if (len <= 0) break;
+        line.append(buffer, static_cast<size_t>(len));
+    }
+    return line.substr(0, line.find('\n'));
+}
+
+static void send_line(int fd, const std::string &line) {
+    auto request = line + "\n";
+    CHECK_EQ(write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+}
+
+// Reads until nothing arrives for timeout_ms.
+static std::string read_available(int fd, int timeout_ms) {
+    std::string data;
+    pollfd pfd{fd, POLLIN, 0};
+    while (poll(&pfd, 1, timeout_ms) > 0) {
+        char buffer[4096];
+        auto len = read(fd, buffer, sizeof(buffer));
+        if (len <= 0) break;
+        data.append(buffer, static_cast<size_t>(len));
+    }
+    return data;
+}
+
+// Publishes until the subscription is active and data arrives, then returns everything sent so far.
+static std::string wait_for_data(SubscriptionServer &server, int fd, size_t board, const BoardReadings &readings) {
+    for (int attempt = 0; attempt < 200; attempt++) {
+        server.publish(board, readings);
+        auto data = read_available(fd, 10);
+        if (!data.empty()) return data + read_available(fd, 50);
+    }
+    return "";
+}
+
+// Splits a binary stream into frames. Returns false if it isn't a whole number of valid frames.
+static bool parse_frames(const std::string &data, std::vector<SampleFrame> &frames) {
+    if (data.size() % sizeof(SampleFrame) != 0) return false;
+    for (size_t offset = 0; offset < data.size(); offset += sizeof(SampleFrame)) {
+        SampleFrame frame;
+        memcpy(&frame, data.data() + offset, sizeof(frame));
+        if (frame.magic != SampleFrame::MAGIC) return false;
+        frames.push_back(frame);
+    }
+    return true;
+}
+
+static std::string socket_path() {
+    return "/tmp/iaq-test-" + std::to_string(getpid()) + ".sock";
+}
+
+static double cpu_seconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void test_json_missing_readings() {
+    auto path = socket_path();
+    SubscriptionServer server(path);
+    server.start();
+
+    int fd = connect_to(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    std::string request = "SUBSCRIBE sensors=0x3f format=json\n";
+    CHECK_EQ(write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+
+    BoardReadings readings{};
+    readings.sample_no = 7;
+    readings.bmp280_temperature = 21.5;
+    readings.bmp280_pressure = NAN;
+    readings.si7021_temperature = NAN;
+    readings.si7021_humidity = 40.25f;
+    auto line = first_line(server, fd, readings);
+
+    CHECK(line.find("\"sample_no\":7") != std::string::npos);
+    CHECK(line.find("\"bmp280_temperature\":21.50") != std::string::npos);
+    CHECK(line.find("\"bmp280_pressure\":null") != std::string::npos);
+    CHECK(line.find("\"si7021_temperature\":null") != std::string::npos);
+    CHECK(line.find("\"si7021_humidity\":40.25") != std::string::npos);
+    CHECK(line.find("nan") == std::string::npos);
+
+    close(fd);
+    server.stop();
+}
+
+// Out of file descriptors, a connection can't be accepted and stays in the backlog. The server must
+// turn it away instead of spinning on the readable listening socket, and recover afterwards.
+static void test_out_of_file_descriptors() {
+    auto path = socket_path();
+    SubscriptionServer server(path);
+    server.start();
+
+    rlimit saved{};
+    getrlimit(RLIMIT_NOFILE, &saved);
+    rlimit limited = saved;
+    limited.rlim_cur = std::min<rlim_t>(saved.rlim_cur, 256);
+    setrlimit(RLIMIT_NOFILE, &limited);
+    std::vector<int> fillers;
+    int filler;
+    while ((filler = open("/dev/null", O_RDONLY)) >= 0) fillers.push_back(filler);
+    CHECK(!fillers.empty());
+    close(fillers.back());
+    fillers.pop_back();
+
+    int rejected = connect_to(path);
+    CHECK(rejected >= 0);
+    pollfd pfd{rejected, POLLIN, 0};
+    CHECK_EQ(poll(&pfd, 1, 2000), 1);
+    char byte;
+    CHECK_EQ(read(rejected, &byte, 1), 0);
+
+    auto cpu_before = cpu_seconds();
+    usleep(200000);
+    CHECK(cpu_seconds() - cpu_before < 0.05);
+
+    close(rejected);
+    for (auto fd : fillers) close(fd);
+    setrlimit(RLIMIT_NOFILE, &saved);
+
+    int fd = connect_to(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    std::string request = "SUBSCRIBE format=json\n";
+    CHECK_EQ(write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+    BoardReadings readings{};
+    readings.sample_no = 3;
+    CHECK(first_line(server, fd, readings).find("\"sample_no\":3") != std::string::npos);
+
+    close(fd);
+    server.stop();
+}
+
+// Fields of unsubscribed sensors are zero, samples of unsubscribed boards aren't sent.
+static void test_binary_frames() {
+    auto path = socket_path();
+    SubscriptionServer server(path);
+    server.start();
+    int fd = connect_to(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    send_line(fd, "SUBSCRIBE boards=0x4 sensors=0x11");
+
+    BoardReadings readings{};
+    readings.sample_no = 42;
+    readings.monotonic_ns = 5000000000ULL;
+    readings.realtime_ns = 1700000000000000000ULL;
+    readings.bmp280_temperature = 21.5;
+    readings.bmp280_pressure = 1013.25;
+    readings.si7021_temperature = 22.0;
+    readings.si7021_humidity = 40.0;
+    readings.ccs811_co2 = 800;
+    readings.ccs811_tvoc = 12;
+    std::vector<SampleFrame> frames;
+    CHECK(parse_frames(wait_for_data(server, fd, 2, readings), frames));
+    CHECK(!frames.empty());
+    if (frames.empty()) return;
+
+    auto &frame = frames.front();
+    CHECK_EQ(frame.board, 2);
+    CHECK_EQ(frame.sensors, SubscriptionServer::BMP280_TEMPERATURE | SubscriptionServer::CCS811_CO2);
+    CHECK_EQ(frame.sample_no, 42u);
+    CHECK_EQ(frame.monotonic_ns, 5000000000ULL);
+    CHECK_EQ(frame.realtime_ns, 1700000000000000000ULL);
+    CHECK_EQ(frame.bmp280_temperature, 21.5);
+    CHECK_EQ(frame.bmp280_pressure, 0.0);
+    CHECK_EQ(frame.si7021_temperature, 0.0);
+    CHECK_EQ(frame.si7021_humidity, 0.0);
+    CHECK_EQ(frame.ccs811_co2, 800);
+    CHECK_EQ(frame.ccs811_tvoc, 0);
+
+    // Samples are handled in order, so board 0 was filtered out once sample 43 of board 2 arrives.
+    readings.sample_no = 99;
+    server.publish(0, readings);
+    readings.sample_no = 43;
+    server.publish(2, readings);
+    frames.clear();
+    CHECK(parse_frames(read_available(fd, 200), frames));
+    CHECK_EQ(frames.size(), 1u);
+    for (auto &f : frames) {
+        CHECK_EQ(f.board, 2);
+        CHECK_EQ(f.sample_no, 43u);
+    }
+
+    close(fd);
+    server.stop();
+}
+
+static void test_interval() {
+    auto path = socket_path();
+    SubscriptionServer server(path);
+    server.start();
+    int fd = connect_to(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    send_line(fd, "SUBSCRIBE boards=0x3 interval_ms=100");
+
+    // Board 1 only tells when the subscription is active, the limit applies to each board.
+    BoardReadings readings{};
+    readings.monotonic_ns = 1000000000ULL;
+    CHECK(!wait_for_data(server, fd, 1, readings).empty());
+
+    for (uint64_t i = 0; i < 50; i++) {
+        readings.sample_no = i;
+        readings.monotonic_ns = 1000000000ULL + i * 10000000ULL;
+        server.publish(0, readings);
+    }
+    std::vector<SampleFrame> frames;
+    CHECK(parse_frames(read_available(fd, 200), frames));
+    CHECK_EQ(frames.size(), 5u);
+    for (size_t i = 0; i < frames.size(); i++) {
+        CHECK_EQ(frames[i].board, 0);
+        CHECK_EQ(frames[i].sample_no, i * 10);
+    }
+
+    close(fd);
+    server.stop();
+}
+
+static void test_resubscribe() {
+    auto path = socket_path();
+    SubscriptionServer server(path);
+    server.start();
+    int fd = connect_to(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    send_line(fd, "SUBSCRIBE format=json");
+
+    BoardReadings readings{};
+    readings.sample_no = 1;
+    CHECK(first_line(server, fd, readings).find("\"sample_no\":1") != std::string::npos);
+    read_available(fd, 100);
+
+    send_line(fd, "SUBSCRIBE sensors=0x2");
+    readings.sample_no = 2;
+    readings.bmp280_pressure = 990.0;
+    std::vector<SampleFrame> frames;
+    CHECK(parse_frames(wait_for_data(server, fd, 0, readings), frames));
+    CHECK(!frames.empty());
+    for (auto &frame : frames) {
+        CHECK_EQ(frame.sensors, SubscriptionServer::BMP280_PRESSURE);
+        CHECK_EQ(frame.sample_no, 2u);
+        CHECK_EQ(frame.bmp280_pressure, 990.0);
+    }
+
+    close(fd);
+    server.stop();
+}
+
+static void test_long_input_disconnects() {
+    auto path = socket_path();
+    SubscriptionServer server(path);
+    server.start();
+    int fd = connect_to(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+
+    std::string garbage(2000, 'x');
+    CHECK_EQ(write(fd, garbage.data(), garbage.size()), static_cast<ssize_t>(garbage.size()));
+    pollfd pfd{fd, POLLIN, 0};
+    CHECK_EQ(poll(&pfd, 1, 2000), 1);
+    char byte;
+    CHECK_EQ(read(fd, &byte, 1), 0);
+
+    close(fd);
+    server.stop();
+}
+
+// A client that doesn't read fills its socket and then its queue. The oldest frames are dropped,
+// including while the head frame is only partially written, and the stream resumes intact with
+// the newest frame once the client reads again.
+static void test_slow_reader() {
+    auto path = socket_path();
+    SubscriptionServer server(path, 64, 2048);
+    server.start();
+    int fd = connect_to(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    send_line(fd, "SUBSCRIBE");
+
+    BoardReadings readings{};
+    CHECK(!wait_for_data(server, fd, 0, readings).empty());
+
+    const uint64_t samples = 5000;
+    for (uint64_t i = 1; i <= samples; i++) {
+        readings.sample_no = i;
+        readings.monotonic_ns = i * 1000;
+        server.publish(0, readings);
+        if (i % 64 == 0) usleep(1000);
+    }
+    usleep(50000);
+    CHECK(server.get_dropped_frames() > 0);
+    readings.sample_no = samples + 1;
+    readings.monotonic_ns = readings.sample_no * 1000;
+    server.publish(0, readings);
+    usleep(50000);
+
+    std::vector<SampleFrame> frames;
+    CHECK(parse_frames(read_available(fd, 200), frames));
+    CHECK(frames.size() < samples);
+    // A frame spliced from two samples would carry the timestamp of another sample.
+    for (size_t i = 0; i < frames.size(); i++) {
+        CHECK_EQ(frames[i].monotonic_ns, frames[i].sample_no * 1000);
+        if (i > 0) CHECK(frames[i].sample_no > frames[i - 1].sample_no);
+    }
+    CHECK(!frames.empty() && frames.back().sample_no == samples + 1);
+
+    close(fd);
+    server.stop();
+}
+
+int main() {
+    test_json_missing_readings();
+    test_out_of_file_descriptors();
+    test_binary_frames();
+    test_interval();
+    test_resubscribe();
+    test_long_input_disconnects();
+    test_slow_reader();
+    return check_failures();
+}
@@ -0,0 +1,33 @@
+// Time of one TemperatureFusion::update() across many boards. Not run by ctest.
+
+#include "TemperatureFusion.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+int main() {
+    const size_t boards = 1000;
+    const int rounds = 10000;
+
+    std::mt19937_64 random(3);
+    std::normal_distribution<double> noise(0, 0.2);
+    std::vector<double> si(boards), bmp(boards);
+    TemperatureFusion fusion(boards);
+
+    double elapsed_s = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < boards; i++) {
+            si[i] = 21 + noise(random);
+            bmp[i] = 22 + noise(random);
+        }
+        auto start = std::chrono::steady_clock::now();
+        fusion.update(si.data(), bmp.data(), 1.0);
+        elapsed_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    printf("%zu boards: %.1f us per update, bias of board 0 %.3f\n", boards, elapsed_s / rounds * 1e6,
+           fusion.get_bmp280_bias(0));
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Runs the fusion filter on synthetic readings with a known BMP280 bias.
+
+#include "Check.h"
+
+#include "TemperatureFusion.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Ambient temperature following a slow daily cycle, read by a Si7021 with 0.1 °C noise and by a
+// BMP280 that reads 1 °C high with 0.2 °C noise.
+struct Scenario {
+    std::mt19937_64 random{7};
+    std::normal_distribution<double> noise{0, 1};
+    double bias = 1.0;
+
+    double ambient(int second) const { return 21 + 2 * std::sin(2 * M_PI * second / 86400.0); }
+
+    double si7021(int second) { return ambient(second) + 0.1 * noise(random); }
+
+    double bmp280(int second) { return ambient(second) + bias + 0.2 * noise(random); }
+};
+
+static void test_learns_bias() {
+    Scenario scenario;
+    TemperatureFusion fusion(1);
+    double fused_error = 0, average_error = 0;
+    int count = 0;
+    for (int second = 0; second < 4 * 3600; second++) {
+        double si = scenario.si7021(second);
+        double bmp = scenario.bmp280(second);
+        fusion.update(&si, &bmp, 1.0);
+        // Skip the first hour while the bias is being learned.
+        if (second < 3600) continue;
+        double truth = scenario.ambient(second);
+        fused_error += std::pow(fusion.get_temperature(0) - truth, 2);
+        average_error += std::pow((si + bmp) / 2 - truth, 2);
+        count++;
+    }
+    double fused_rms = std::sqrt(fused_error / count);
+    double average_rms = std::sqrt(average_error / count);
+
+    CHECK_NEAR(fusion.get_bmp280_bias(0), 1.0, 0.05);
+    CHECK(fused_rms < 0.1);
+    CHECK(average_rms > 0.45);
+    std::cout << "RMS error fused " << fused_rms << " °C, average " << average_rms << " °C" << std::endl;
+}
+
+static void test_missing_readings() {
+    Scenario scenario;
+    // Board 0 gets both readings, board 1 loses its Si7021 after a while and board 2 never has
+    // a complete pair.
+    TemperatureFusion fusion(3);
+    double si[3], bmp[3];
+    const double missing = NAN;
+
+    for (int i = 0; i < 3; i++) CHECK(std::isnan(fusion.get_temperature(i)));
+
+    for (int second = 0; second < 7200; second++) {
+        for (int i = 0; i < 3; i++) {
+            si[i] = scenario.si7021(second);
+            bmp[i] = scenario.bmp280(second);
+        }
+        if (second >= 3600) si[1] = missing;
+        if (second % 2 == 0) si[2] = missing; else bmp[2] = missing;
+        fusion.update(si, bmp, 1.0);
+
+        if (second == 0) {
+            CHECK(!std::isnan(fusion.get_temperature(0)));
+            CHECK(!std::isnan(fusion.get_temperature(1)));
+        }
+    }
+
+    double truth = scenario.ambient(7199);
+    CHECK_NEAR(fusion.get_temperature(0), truth, 0.2);
+    // Without the Si7021 the BMP280 reading minus the learned bias carries on.
+    CHECK_NEAR(fusion.get_temperature(1), truth, 0.3);
+    CHECK_NEAR(fusion.get_bmp280_bias(1), 1.0, 0.1);
+    CHECK(std::isnan(fusion.get_temperature(2)));
+
+    // Both readings missing leaves the estimate alone but grows its variance.
+    double before = fusion.get_temperature(0);
+    double variance = fusion.get_variance(0);
+    si[0] = missing;
+    bmp[0] = missing;
+    fusion.update(si, bmp, 1.0);
+    CHECK_EQ(fusion.get_temperature(0), before);
+    CHECK(fusion.get_variance(0) > variance);
+}
+
+int main() {
+    test_learns_bias();
+    test_missing_readings();
+    return check_failures();
+}
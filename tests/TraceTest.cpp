@@ -0,0 +1,183 @@
+// Records events and checks what the Chrome trace-event export contains.
+
+#include "Check.h"
+
+#include "Trace.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Just enough of a JSON parser to tell whether the export is well formed.
+class JsonValidator {
+public:
+    explicit JsonValidator(const std::string &text) : text(text) {}
+
+    bool valid() {
+        pos = 0;
+        if (!value()) return false;
+        skip_space();
+        return pos == text.size();
+    }
+
+private:
+    const std::string &text;
+    size_t pos = 0;
+
+    void skip_space() {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) pos++;
+    }
+
+    bool consume(char c) {
+        skip_space();
+        if (pos >= text.size() || text[pos] != c) return false;
+        pos++;
+        return true;
+    }
+
+    bool string() {
+        if (!consume('"')) return false;
+        while (pos < text.size() && text[pos] != '"') {
+            if (text[pos] == '\\') pos++;
+            pos++;
+        }
+        return pos++ < text.size();
+    }
+
+    bool number() {
+        skip_space();
+        auto start = pos;
+        if (pos < text.size() && text[pos] == '-') pos++;
+        while (pos < text.size() && (std::isdigit(static_cast<unsigned char>(text[pos])) || text[pos] == '.')) pos++;
+        return pos > start;
+    }
+
+    template<typename Element>
+    bool sequence(char close, Element element) {
+        if (consume(close)) return true;
+        do {
+            if (!element()) return false;
+        } while (consume(','));
+        return consume(close);
+    }
+
+    bool value() {
+        skip_space();
+        if (pos >= text.size()) return false;
+        if (text[pos] == '"') return string();
+        if (consume('[')) return sequence(']', [this] { return value(); });
+        if (consume('{')) return sequence('}', [this] { return string() && consume(':') && value(); });
+        return number();
+    }
+};
+
+std::string export_json() {
+    std::ostringstream out;
+    Trace::write_chrome_json(out);
+    return out.str();
+}
+
+// Begin timestamps in µs of the exported events with the given name, in export order.
+std::vector<uint64_t> event_times(const std::string &json, const std::string &name) {
+    std::vector<uint64_t> times;
+    auto key = "\"name\":\"" + name + "\",\"ts\":";
+    for (auto pos = json.find(key); pos != std::string::npos; pos = json.find(key, pos + 1)) {
+        times.push_back(strtoull(json.c_str() + pos + key.size(), nullptr, 10));
+    }
+    return times;
+}
+
+}
+
+static void test_disabled() {
+    Trace::clear();
+    Trace::set_enabled(false);
+    {
+        TraceScope scope("test", "disabled");
+    }
+    CHECK(event_times(export_json(), "disabled").empty());
+
+    Trace::set_enabled(true);
+    {
+        TraceScope scope("test", "enabled");
+    }
+    Trace::set_enabled(false);
+    CHECK_EQ(event_times(export_json(), "enabled").size(), 1u);
+}
+
+// Once a buffer wrapped, the export holds the newest events in order. The slot the next event
+// would go to is dropped as it could be in the middle of a write.
+static void test_overflow() {
+    Trace::clear();
+    const uint64_t events = Trace::BUFFER_CAPACITY * 2 + 100;
+    for (uint64_t i = 0; i < events; i++) {
+        Trace::record("test", "overflow", i * 1000, i * 1000 + 500);
+    }
+
+    auto json = export_json();
+    CHECK(JsonValidator(json).valid());
+    auto times = event_times(json, "overflow");
+    CHECK(times.size() >= Trace::BUFFER_CAPACITY - 1 && times.size() <= Trace::BUFFER_CAPACITY);
+    CHECK(!times.empty() && times.back() == events - 1);
+    for (size_t i = 1; i < times.size(); i++) {
+        if (times[i] != times[i - 1] + 1) {
+            CHECK_EQ(times[i], times[i - 1] + 1);
+            break;
+        }
+    }
+    CHECK(json.find("\"ts\":" + std::to_string(events - 1) + ".000,\"dur\":0.500}") != std::string::npos);
+}
+
+static void test_clear() {
+    Trace::record("test", "before_clear", 1000, 2000);
+    Trace::clear();
+    Trace::record("test", "after_clear", 3000, 4000);
+
+    auto json = export_json();
+    CHECK(JsonValidator(json).valid());
+    CHECK(event_times(json, "before_clear").empty());
+    CHECK_EQ(event_times(json, "after_clear").size(), 1u);
+}
+
+static void test_exited_thread() {
+    Trace::clear();
+    std::thread worker([] { Trace::record("test", "worker", 5000, 6000); });
+    worker.join();
+    Trace::record("test", "main", 7000, 8000);
+
+    auto json = export_json();
+    CHECK(JsonValidator(json).valid());
+    CHECK_EQ(event_times(json, "worker").size(), 1u);
+    CHECK_EQ(event_times(json, "main").size(), 1u);
+}
+
+// The export must neither depend on nor change the formatting state of the caller's stream.
+static void test_stream_state() {
+    Trace::clear();
+    Trace::record("test", "format", 1234567, 1234568);
+
+    std::ostringstream out;
+    out << std::hex << std::setfill('*');
+    Trace::write_chrome_json(out);
+    CHECK(out.str().find("\"ts\":1234.567,\"dur\":0.001}") != std::string::npos);
+
+    std::ostringstream after;
+    after.copyfmt(out);
+    after << std::setw(3) << 10;
+    CHECK_EQ(after.str(), std::string("**a"));
+}
+
+int main() {
+    test_disabled();
+    test_overflow();
+    test_clear();
+    test_exited_thread();
+    test_stream_state();
+    return check_failures();
+}